@@ -0,0 +1,46 @@
+#include <benchmark/benchmark.h>
+#include <functional>
+#include <memory>
+#include <random>
+#include <string>
+#include <vector>
+#include "cache_shard.h"
+
+// Cache hits against an index split into state.range(0) shards, picked as
+// GCSCache::shard_for does. One shard is the single-lock index the cache
+// had before sharding.
+namespace {
+
+constexpr size_t Keys = 100000;
+
+std::vector<std::unique_ptr<CacheShard>> shards;
+std::vector<std::string> keys;
+
+CacheShard& shard_for(const std::string& key) {
+    return *shards[std::hash<std::string>{}(key) % shards.size()];
+}
+
+void BM_CacheShardHit(benchmark::State& state) {
+    if (state.thread_index() == 0) {
+        shards.clear();
+        keys.clear();
+        for (int64_t i = 0; i < state.range(0); ++i) shards.push_back(std::make_unique<CacheShard>("lru", false));
+        for (size_t i = 0; i < Keys; ++i) {
+            keys.push_back("my_bucket/object_" + std::to_string(i));
+            shard_for(keys.back()).insert(keys.back(), 1024 * 1024, 1024 * 1024, 1);
+        }
+    }
+    std::mt19937 random(state.thread_index());
+    std::uniform_int_distribution<size_t> pick(0, Keys - 1);
+    for (auto _ : state) {
+        const std::string& key = keys[pick(random)];
+        CacheShard& shard = shard_for(key);
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        benchmark::DoNotOptimize(shard.touch(key).size);
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+
+}  // namespace
+
+BENCHMARK(BM_CacheShardHit)->RangeMultiplier(4)->Range(1, 64)->ThreadRange(1, 64)->UseRealTime();
@@ -0,0 +1,39 @@
+#pragma once
+#include <condition_variable>
+#include <cstddef>
+#include <mutex>
+
+// RamTracker as it was before the FIFO rework: one mutex and condition
+// variable for every reservation. Kept only to benchmark against.
+class MutexRamTracker {
+public:
+    explicit MutexRamTracker(size_t max_bytes) : max_bytes_(max_bytes), used_bytes_(0) {}
+
+    bool try_reserve(size_t bytes) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (used_bytes_ + bytes > max_bytes_) return false;
+        used_bytes_ += bytes;
+        return true;
+    }
+
+    void wait_and_reserve(size_t bytes) {
+        std::unique_lock<std::mutex> lock(mutex_);
+        cond_.wait(lock, [&] { return used_bytes_ + bytes <= max_bytes_; });
+        used_bytes_ += bytes;
+    }
+
+    void release(size_t bytes) {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            used_bytes_ -= bytes;
+        }
+        cond_.notify_one();
+    }
+
+private:
+    const size_t max_bytes_;
+    size_t used_bytes_;
+
+    std::mutex mutex_;
+    std::condition_variable cond_;
+};
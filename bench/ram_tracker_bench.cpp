@@ -0,0 +1,47 @@
+#include <benchmark/benchmark.h>
+#include <memory>
+#include <type_traits>
+#include "constants.h"
+#include "mutex_ram_tracker.h"
+#include "ram_tracker.h"
+
+// Every thread reserves and releases one stream chunk at a time, as
+// ObjectReader does per read. "Roomy" leaves room for every thread, so only
+// the bookkeeping is measured; "Tight" has room for four chunks, so most
+// reservations wait.
+namespace {
+
+constexpr size_t Chunk = Constants::StreamBufferSize;
+constexpr size_t RoomyBytes = 64 * 1024 * 1024;
+constexpr size_t TightBytes = 4 * Chunk;
+
+std::unique_ptr<RamTracker> ram_tracker;
+std::unique_ptr<MutexRamTracker> mutex_ram_tracker;
+
+template <class Tracker>
+void reserve_release(benchmark::State& state, std::unique_ptr<Tracker>& tracker, size_t max_bytes) {
+    if (state.thread_index() == 0) {
+        if constexpr (std::is_same_v<Tracker, RamTracker>) {
+            tracker = std::make_unique<RamTracker>(max_bytes, RamTracker::TenantBudget{});
+        } else {
+            tracker = std::make_unique<Tracker>(max_bytes);
+        }
+    }
+    for (auto _ : state) {
+        tracker->wait_and_reserve(Chunk);
+        tracker->release(Chunk);
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+
+void BM_RamTrackerRoomy(benchmark::State& state) { reserve_release(state, ram_tracker, RoomyBytes); }
+void BM_MutexRamTrackerRoomy(benchmark::State& state) { reserve_release(state, mutex_ram_tracker, RoomyBytes); }
+void BM_RamTrackerTight(benchmark::State& state) { reserve_release(state, ram_tracker, TightBytes); }
+void BM_MutexRamTrackerTight(benchmark::State& state) { reserve_release(state, mutex_ram_tracker, TightBytes); }
+
+}  // namespace
+
+BENCHMARK(BM_RamTrackerRoomy)->ThreadRange(1, 64)->UseRealTime();
+BENCHMARK(BM_MutexRamTrackerRoomy)->ThreadRange(1, 64)->UseRealTime();
+BENCHMARK(BM_RamTrackerTight)->ThreadRange(1, 64)->UseRealTime();
+BENCHMARK(BM_MutexRamTrackerTight)->ThreadRange(1, 64)->UseRealTime();
@@ -0,0 +1,132 @@
+#include "buffer_pool.h"
+#include <cstdlib>
+#include <new>
+#include <utility>
+#include <sys/mman.h>
+#include "constants.h"
+
+static_assert(Constants::BufferPoolMinBuffer % Constants::BufferPoolPageSize == 0,
+              "buffers must start on page boundaries");
+
+namespace {
+
+constexpr uint64_t IndexMask = 0xffffffffu;
+
+}  // namespace
+
+BufferPool::Lease::Lease(Lease&& other) noexcept
+    : pool_(other.pool_), data_(other.data_), size_(other.size_), borrowed_(other.borrowed_),
+      tenant_(std::move(other.tenant_)) {
+    other.data_ = nullptr;
+}
+
+BufferPool::Lease& BufferPool::Lease::operator=(Lease&& other) noexcept {
+    if (this != &other) {
+        reset();
+        pool_ = other.pool_;
+        data_ = other.data_;
+        size_ = other.size_;
+        borrowed_ = other.borrowed_;
+        tenant_ = std::move(other.tenant_);
+        other.data_ = nullptr;
+    }
+    return *this;
+}
+
+BufferPool::Lease::~Lease() {
+    reset();
+}
+
+void BufferPool::Lease::reset() {
+    if (!data_) return;
+    pool_->give_back(*this);
+    data_ = nullptr;
+}
+
+BufferPool::BufferPool(RamTracker& ram_tracker, size_t capacity, bool huge_pages)
+    : ram_tracker_(ram_tracker), capacity_(capacity / Constants::BufferPoolPageSize * Constants::BufferPoolPageSize) {
+    static_assert(Constants::BufferPoolMinBuffer << (ClassCount - 1) == Constants::BufferPoolMaxBuffer,
+                  "one size class per power of two");
+    for (auto& head : free_) head = 0;
+    if (capacity_ == 0) return;
+    // Address space only; pages are committed the first time a buffer is used
+    void* slab = ::mmap(nullptr, capacity_, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    if (slab == MAP_FAILED) {
+        // Every lease comes from the heap instead
+        capacity_ = 0;
+        return;
+    }
+    slab_ = static_cast<char*>(slab);
+    next_.reset(new std::atomic<uint32_t>[capacity_ / Constants::BufferPoolPageSize]());
+    if (huge_pages) ::madvise(slab_, capacity_, MADV_HUGEPAGE);
+}
+
+BufferPool::~BufferPool() {
+    if (slab_) ::munmap(slab_, capacity_);
+}
+
+BufferPool::Lease BufferPool::lease(size_t size, std::chrono::steady_clock::time_point deadline,
+                                    const RamTracker::Tenant& tenant) {
+    size_t size_class = 0;
+    while ((Constants::BufferPoolMinBuffer << size_class) < size && size_class + 1 < ClassCount) ++size_class;
+    size_t bytes = Constants::BufferPoolMinBuffer << size_class;
+
+    bool borrowed;
+    if (!ram_tracker_.try_reserve_until(bytes, deadline, tenant, borrowed)) return Lease();
+    char* data = take(size_class);
+    if (!data) {
+        // The slab is all carved, and held by other sizes' free lists
+        data = static_cast<char*>(std::aligned_alloc(Constants::BufferPoolPageSize, bytes));
+        if (!data) {
+            ram_tracker_.release(bytes, tenant);
+            throw std::bad_alloc();
+        }
+    }
+    Lease lease;
+    lease.pool_ = this;
+    lease.data_ = data;
+    lease.size_ = bytes;
+    lease.borrowed_ = borrowed;
+    lease.tenant_ = tenant;
+    return lease;
+}
+
+char* BufferPool::take(size_t size_class) {
+    uint64_t head = free_[size_class].load(std::memory_order_acquire);
+    while (head & IndexMask) {
+        size_t page = (head & IndexMask) - 1;
+        char* buffer = slab_ + page * Constants::BufferPoolPageSize;
+        // May read a buffer another thread just took; the tag then fails the CAS
+        uint64_t next = next_[page].load(std::memory_order_relaxed);
+        uint64_t popped = (((head >> 32) + 1) << 32) | next;
+        if (free_[size_class].compare_exchange_weak(head, popped, std::memory_order_acquire)) return buffer;
+    }
+
+    size_t bytes = Constants::BufferPoolMinBuffer << size_class;
+    size_t carved = carved_.load(std::memory_order_relaxed);
+    while (carved + bytes <= capacity_) {
+        if (carved_.compare_exchange_weak(carved, carved + bytes, std::memory_order_relaxed)) return slab_ + carved;
+    }
+    return nullptr;
+}
+
+void BufferPool::give_back(const Lease& lease) {
+    char* data = lease.data_;
+    size_t size = lease.size_;
+    if (data >= slab_ && data < slab_ + capacity_) {
+        size_t size_class = 0;
+        while ((Constants::BufferPoolMinBuffer << size_class) < size) ++size_class;
+        size_t page = (data - slab_) / Constants::BufferPoolPageSize;
+        uint64_t index = page + 1;
+        // Not on the list yet, so nobody can be using it
+        ::madvise(data, size, MADV_DONTNEED);
+        uint64_t head = free_[size_class].load(std::memory_order_relaxed);
+        do {
+            next_[page].store(static_cast<uint32_t>(head & IndexMask), std::memory_order_relaxed);
+        } while (!free_[size_class].compare_exchange_weak(head, (((head >> 32) + 1) << 32) | index,
+                                                          std::memory_order_release, std::memory_order_relaxed));
+    } else {
+        std::free(data);
+    }
+    ram_tracker_.release(size, lease.tenant_);
+}
@@ -0,0 +1,72 @@
+#pragma once
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include "ram_tracker.h"
+
+// Stream buffers carved from one page-aligned slab the size of the max_ram
+// budget. A leased buffer is reserved from the RamTracker until it is
+// returned, so leases and the RAM tier share that budget and the tracker's
+// count is the pool's occupancy. Returned buffers go on a lock-free free
+// list per size class, and the next lease of that size reuses them. Their
+// pages are handed back to the kernel first: a slab page stays in the class
+// it was carved for, so a free one kept resident would sit on top of the
+// heap buffers other classes fall back to once the slab is all carved.
+class BufferPool {
+public:
+    // One leased buffer, returned to the pool on destruction
+    class Lease {
+    public:
+        Lease() = default;
+        Lease(Lease&& other) noexcept;
+        Lease& operator=(Lease&& other) noexcept;
+        ~Lease();
+
+        char* data() const { return data_; }
+        size_t size() const { return size_; }
+        // Past its tenant's guaranteed minimum; return it when the
+        // RamTracker wants memory reclaimed
+        bool borrowed() const { return borrowed_; }
+        explicit operator bool() const { return data_ != nullptr; }
+        void reset();
+
+    private:
+        friend class BufferPool;
+        BufferPool* pool_ = nullptr;
+        char* data_ = nullptr;
+        size_t size_ = 0;
+        bool borrowed_ = false;
+        RamTracker::Tenant tenant_;
+    };
+
+    BufferPool(RamTracker& ram_tracker, size_t capacity, bool huge_pages);
+    ~BufferPool();
+
+    BufferPool(const BufferPool&) = delete;
+    BufferPool& operator=(const BufferPool&) = delete;
+
+    // A buffer of at least size bytes, rounded up to a power of two between
+    // BufferPoolMinBuffer and BufferPoolMaxBuffer, charged to tenant. Waits
+    // for the RamTracker to have room for it, and returns an empty lease if
+    // deadline passes first.
+    Lease lease(size_t size, std::chrono::steady_clock::time_point deadline, const RamTracker::Tenant& tenant);
+
+private:
+    static constexpr size_t ClassCount = 7;
+
+    RamTracker& ram_tracker_;
+    char* slab_ = nullptr;
+    size_t capacity_;
+    std::atomic<size_t> carved_{0};
+    // Per class: the free list head, as the page index of the first free
+    // buffer plus one (0 when empty) in the low half and an ABA tag above
+    std::atomic<uint64_t> free_[ClassCount];
+    // Per slab page: the next free buffer's list head value, kept out of the
+    // buffers so their pages can be dropped while they are free
+    std::unique_ptr<std::atomic<uint32_t>[]> next_;
+
+    char* take(size_t size_class);
+    void give_back(const Lease& lease);
+};
@@ -0,0 +1,125 @@
+#include "cache_shard.h"
+
+CacheShard::CacheShard(const std::string& eviction_policy, bool byte_hit_ratio)
+    : policy_(make_eviction_policy(eviction_policy, byte_hit_ratio)) {}
+
+bool CacheShard::contains(const std::string& key) const {
+    return index_.find(key) != index_.end();
+}
+
+const CacheEntry& CacheShard::touch(const std::string& key) {
+    auto& entry = index_.at(key);
+    if (entry.in_window) {
+        window_keys_.splice(window_keys_.begin(), window_keys_, entry.window_it);
+    } else {
+        std::visit([&](auto& policy) { policy.on_hit(key); }, policy_);
+    }
+    ++entry.hits;
+    return entry;
+}
+
+const CacheEntry* CacheShard::find(const std::string& key) const {
+    auto it = index_.find(key);
+    return it == index_.end() ? nullptr : &it->second;
+}
+
+CacheEntry* CacheShard::find(const std::string& key) {
+    auto it = index_.find(key);
+    return it == index_.end() ? nullptr : &it->second;
+}
+
+size_t CacheShard::insert(const std::string& key, size_t size, size_t disk_size, int64_t generation, bool in_window,
+                          std::optional<uint32_t> crc32c) {
+    size_t replaced = 0;
+    auto it = index_.find(key);
+    if (it != index_.end()) {
+        replaced = remove(it);
+    }
+    CacheEntry entry{size, disk_size, generation, 0, in_window, window_keys_.end(), crc32c, 0, {}};
+    if (in_window) {
+        window_keys_.push_front(key);
+        entry.window_it = window_keys_.begin();
+        window_bytes_ += size;
+    } else {
+        std::visit([&](auto& policy) { policy.on_insert(key, size); }, policy_);
+    }
+    index_.emplace(key, entry);
+    size_bytes_ += size;
+    return replaced;
+}
+
+size_t CacheShard::erase(const std::string& key) {
+    auto it = index_.find(key);
+    if (it == index_.end()) return 0;
+    return remove(it);
+}
+
+bool CacheShard::pop_victim(std::string& key, size_t& disk_size) {
+    bool evicted = std::visit([&](auto& policy) { return policy.evict(key); }, policy_);
+    if (!evicted) return pop_window_lru(key, disk_size);
+
+    auto it = index_.find(key);
+    disk_size = it->second.disk_size;
+    size_bytes_ -= it->second.size;
+    index_.erase(it);
+    return true;
+}
+
+bool CacheShard::peek_victim(std::string& key) const {
+    return std::visit([&](const auto& policy) { return policy.peek_victim(key); }, policy_);
+}
+
+bool CacheShard::peek_window_lru(std::string& key) const {
+    if (window_keys_.empty()) return false;
+    key = window_keys_.back();
+    return true;
+}
+
+bool CacheShard::pop_window_lru(std::string& key, size_t& disk_size) {
+    if (window_keys_.empty()) return false;
+    key = window_keys_.back();
+    disk_size = remove(index_.find(key));
+    return true;
+}
+
+void CacheShard::promote_window_lru() {
+    if (window_keys_.empty()) return;
+    const std::string& key = window_keys_.back();
+    auto& entry = index_.at(key);
+    entry.in_window = false;
+    entry.window_it = window_keys_.end();
+    window_bytes_ -= entry.size;
+    std::visit([&](auto& policy) { policy.on_insert(key, entry.size); }, policy_);
+    window_keys_.pop_back();
+}
+
+size_t CacheShard::size_bytes() const {
+    return size_bytes_.load(std::memory_order_relaxed);
+}
+
+size_t CacheShard::window_bytes() const {
+    return window_bytes_.load(std::memory_order_relaxed);
+}
+
+void CacheShard::for_each_lru(const std::function<void(const std::string&, const CacheEntry&)>& fn) const {
+    std::visit([&](const auto& policy) {
+        policy.for_each([&](const std::string& key) { fn(key, index_.at(key)); });
+    }, policy_);
+    for (auto it = window_keys_.rbegin(); it != window_keys_.rend(); ++it) {
+        fn(*it, index_.at(*it));
+    }
+}
+
+size_t CacheShard::remove(std::unordered_map<std::string, CacheEntry>::iterator it) {
+    size_t size = it->second.size;
+    if (it->second.in_window) {
+        window_keys_.erase(it->second.window_it);
+        window_bytes_ -= size;
+    } else {
+        std::visit([&](auto& policy) { policy.on_erase(it->first); }, policy_);
+    }
+    size_bytes_ -= size;
+    size_t disk_size = it->second.disk_size;
+    index_.erase(it);
+    return disk_size;
+}
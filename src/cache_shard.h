@@ -0,0 +1,78 @@
+#pragma once
+#include "eviction_policy.h"
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <unordered_map>
+
+struct InFlightFill;
+
+struct CacheEntry {
+    size_t size;
+    size_t disk_size;           // of its file in cache_dir; less than size when compressed
+    int64_t generation;
+    size_t hits;
+    bool in_window;
+    std::list<std::string>::iterator window_it;  // valid while in_window
+    std::optional<uint32_t> crc32c;
+    int64_t metageneration;     // 0 if unknown, e.g. for entries restored at startup
+    std::chrono::steady_clock::time_point fresh_until;  // ttl consistency: recheck after this
+};
+
+// One hash partition of the cache index. Callers hold `mutex` for every
+// call except size_bytes() and window_bytes(), which may be read lock-free.
+//
+// Entries live either in the admission window, an LRU where new objects
+// start out, or in the main cache, which is ordered by the configured
+// eviction policy. With admission disabled every entry goes straight to
+// main.
+class CacheShard {
+public:
+    CacheShard(const std::string& eviction_policy, bool byte_hit_ratio);
+
+    std::mutex mutex;
+    std::unordered_map<std::string, std::shared_ptr<InFlightFill>> in_flight;
+
+    bool contains(const std::string& key) const;
+    const CacheEntry& touch(const std::string& key);
+    // Looks an entry up without counting it as a hit; nullptr if absent.
+    const CacheEntry* find(const std::string& key) const;
+    CacheEntry* find(const std::string& key);
+    // Returns the disk size of the entry it replaced, or 0.
+    size_t insert(const std::string& key, size_t size, size_t disk_size, int64_t generation, bool in_window = false,
+                  std::optional<uint32_t> crc32c = std::nullopt);
+    // Returns the disk size of the removed entry, or 0.
+    size_t erase(const std::string& key);
+
+    // Removes the main cache's eviction victim, or the window's LRU entry if
+    // main is empty, and sets disk_size to its. Returns false if the shard
+    // is empty.
+    bool pop_victim(std::string& key, size_t& disk_size);
+    bool peek_victim(std::string& key) const;
+
+    bool peek_window_lru(std::string& key) const;
+    bool pop_window_lru(std::string& key, size_t& disk_size);
+    // Moves the window's least recently used entry into the main cache.
+    void promote_window_lru();
+
+    size_t size_bytes() const;
+    size_t window_bytes() const;
+
+    // Visits main entries coldest first, then the window's.
+    void for_each_lru(const std::function<void(const std::string&, const CacheEntry&)>& fn) const;
+
+private:
+    std::unordered_map<std::string, CacheEntry> index_;
+    EvictionPolicy policy_;
+    std::list<std::string> window_keys_;
+    std::atomic<size_t> size_bytes_{0};
+    std::atomic<size_t> window_bytes_{0};
+
+    size_t remove(std::unordered_map<std::string, CacheEntry>::iterator it);
+};
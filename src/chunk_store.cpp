@@ -0,0 +1,265 @@
+#include "chunk_store.h"
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <functional>
+#include <stdexcept>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <openssl/evp.h>
+
+namespace {
+
+constexpr char RecipeMagic[8] = {'M', 'R', 'P', 'H', 'C', 'D', 'C', '1'};
+constexpr size_t HashBytes = 32;
+
+struct RecipeHeader {
+    char magic[8];
+    uint64_t size;
+    uint64_t count;
+};
+
+struct RecipeEntry {
+    unsigned char hash[HashBytes];
+    uint32_t length;
+    uint32_t reserved;
+};
+
+std::string to_hex(const unsigned char* bytes, size_t len) {
+    static const char digits[] = "0123456789abcdef";
+    std::string hex(len * 2, '0');
+    for (size_t i = 0; i < len; ++i) {
+        hex[2 * i] = digits[bytes[i] >> 4];
+        hex[2 * i + 1] = digits[bytes[i] & 0xf];
+    }
+    return hex;
+}
+
+bool from_hex(const std::string& hex, unsigned char* bytes, size_t len) {
+    if (hex.size() != len * 2) return false;
+    for (size_t i = 0; i < len; ++i) {
+        unsigned int value;
+        if (std::sscanf(hex.c_str() + 2 * i, "%2x", &value) != 1) return false;
+        bytes[i] = static_cast<unsigned char>(value);
+    }
+    return true;
+}
+
+bool write_file(const std::string& path, const char* data, size_t len) {
+    int fd = ::open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) return false;
+    bool ok = true;
+    while (len > 0) {
+        ssize_t written = ::write(fd, data, len);
+        if (written < 0) {
+            if (errno == EINTR) continue;
+            ok = false;
+            break;
+        }
+        data += written;
+        len -= written;
+    }
+    return ::close(fd) == 0 && ok;
+}
+
+}  // namespace
+
+ChunkStore::ChunkStore(const std::string& cache_dir)
+    : dir_(cache_dir + "/.chunks") {}
+
+ChunkStore::Stripe& ChunkStore::stripe_for(const std::string& hash) {
+    return stripes_[std::hash<std::string>{}(hash) % stripes_.size()];
+}
+
+std::string ChunkStore::chunk_path(const std::string& hash) const {
+    return dir_ + "/" + hash.substr(0, 2) + "/" + hash;
+}
+
+size_t ChunkStore::put(const std::string& hash, const char* data, size_t len) {
+    Stripe& stripe = stripe_for(hash);
+    std::lock_guard<std::mutex> lock(stripe.mutex);
+    auto it = stripe.chunks.find(hash);
+    if (it != stripe.chunks.end()) {
+        if (it->second.damaged) {
+            write_chunk(hash, data, len);
+            it->second.damaged = false;
+        }
+        // A chunk kept only for its readers was already counted as freed
+        size_t added = it->second.refs == 0 ? it->second.size : 0;
+        ++it->second.refs;
+        return added;
+    }
+
+    write_chunk(hash, data, len);
+    stripe.chunks.emplace(hash, Chunk{1, 0, static_cast<uint32_t>(len)});
+    return len;
+}
+
+// Chunk writes are small; doing them under the stripe lock keeps a second
+// fill with the same chunk from referencing it before it exists
+void ChunkStore::write_chunk(const std::string& hash, const char* data, size_t len) {
+    std::string path = chunk_path(hash);
+    std::error_code ec;
+    std::filesystem::create_directories(std::filesystem::path(path).parent_path(), ec);
+    if (!write_file(path + ".tmp", data, len) || ::rename((path + ".tmp").c_str(), path.c_str()) != 0) {
+        ::unlink((path + ".tmp").c_str());
+        throw std::runtime_error("Failed to store chunk " + hash + ": " + std::strerror(errno));
+    }
+}
+
+bool ChunkStore::add_refs(const Recipe& recipe, size_t& added_bytes) {
+    added_bytes = 0;
+    for (const auto& chunk : recipe.chunks) {
+        if (contains(chunk.hash)) continue;
+        struct stat st;
+        if (::stat(chunk_path(chunk.hash).c_str(), &st) != 0 || st.st_size != chunk.length) return false;
+    }
+    for (const auto& chunk : recipe.chunks) {
+        Stripe& stripe = stripe_for(chunk.hash);
+        std::lock_guard<std::mutex> lock(stripe.mutex);
+        auto [it, inserted] = stripe.chunks.emplace(chunk.hash, Chunk{0, 0, chunk.length});
+        if (inserted) added_bytes += chunk.length;
+        ++it->second.refs;
+    }
+    return true;
+}
+
+size_t ChunkStore::release(const Recipe& recipe) {
+    size_t freed = 0;
+    for (const auto& chunk : recipe.chunks) {
+        Stripe& stripe = stripe_for(chunk.hash);
+        std::lock_guard<std::mutex> lock(stripe.mutex);
+        auto it = stripe.chunks.find(chunk.hash);
+        if (it == stripe.chunks.end() || it->second.refs == 0) continue;
+        if (--it->second.refs == 0) {
+            freed += it->second.size;
+            remove_if_unused(stripe, chunk.hash);
+        }
+    }
+    return freed;
+}
+
+void ChunkStore::pin(const Recipe& recipe) {
+    for (const auto& chunk : recipe.chunks) {
+        Stripe& stripe = stripe_for(chunk.hash);
+        std::lock_guard<std::mutex> lock(stripe.mutex);
+        auto it = stripe.chunks.find(chunk.hash);
+        if (it != stripe.chunks.end()) ++it->second.readers;
+    }
+}
+
+void ChunkStore::unpin(const Recipe& recipe) {
+    for (const auto& chunk : recipe.chunks) {
+        Stripe& stripe = stripe_for(chunk.hash);
+        std::lock_guard<std::mutex> lock(stripe.mutex);
+        auto it = stripe.chunks.find(chunk.hash);
+        if (it == stripe.chunks.end() || it->second.readers == 0) continue;
+        --it->second.readers;
+        remove_if_unused(stripe, chunk.hash);
+    }
+}
+
+bool ChunkStore::contains(const std::string& hash) {
+    Stripe& stripe = stripe_for(hash);
+    std::lock_guard<std::mutex> lock(stripe.mutex);
+    return stripe.chunks.count(hash) > 0;
+}
+
+bool ChunkStore::verify(const std::string& hash) {
+    // Under the stripe lock so a put() cannot rewrite the file between the
+    // check and the delete
+    Stripe& stripe = stripe_for(hash);
+    std::lock_guard<std::mutex> lock(stripe.mutex);
+    auto it = stripe.chunks.find(hash);
+    if (it == stripe.chunks.end()) return true;
+    if (it->second.damaged) return false;
+
+    std::string path = chunk_path(hash);
+    std::string data(it->second.size, '\0');
+    int fd = ::open(path.c_str(), O_RDONLY);
+    struct stat st;
+    bool intact = fd >= 0 && ::fstat(fd, &st) == 0 && st.st_size == static_cast<off_t>(data.size()) &&
+                  ::pread(fd, data.data(), data.size(), 0) == static_cast<ssize_t>(data.size()) &&
+                  hash_chunk(data.data(), data.size()) == hash;
+    if (fd >= 0) ::close(fd);
+    if (!intact) {
+        it->second.damaged = true;
+        ::unlink(path.c_str());
+    }
+    return intact;
+}
+
+bool ChunkStore::remove_orphan(const std::string& file_name) {
+    const std::string tmp_suffix = ".tmp";
+    std::string hash = file_name;
+    if (hash.size() > tmp_suffix.size() &&
+        hash.compare(hash.size() - tmp_suffix.size(), tmp_suffix.size(), tmp_suffix) == 0) {
+        hash.resize(hash.size() - tmp_suffix.size());
+    }
+    // put() only leaves a .tmp behind while it holds the stripe lock
+    Stripe& stripe = stripe_for(hash);
+    std::lock_guard<std::mutex> lock(stripe.mutex);
+    if (hash == file_name && stripe.chunks.count(hash)) return false;
+    return ::unlink((dir_ + "/" + hash.substr(0, 2) + "/" + file_name).c_str()) == 0;
+}
+
+void ChunkStore::remove_if_unused(Stripe& stripe, const std::string& hash) {
+    auto it = stripe.chunks.find(hash);
+    if (it->second.refs > 0 || it->second.readers > 0) return;
+    ::unlink(chunk_path(hash).c_str());
+    stripe.chunks.erase(it);
+}
+
+std::string ChunkStore::hash_chunk(const char* data, size_t len) {
+    unsigned char digest[EVP_MAX_MD_SIZE];
+    unsigned int digest_len = 0;
+    if (!EVP_Digest(data, len, digest, &digest_len, EVP_sha256(), nullptr)) {
+        throw std::runtime_error("SHA-256 failed");
+    }
+    return to_hex(digest, digest_len);
+}
+
+size_t ChunkStore::recipe_bytes(const Recipe& recipe) {
+    return sizeof(RecipeHeader) + recipe.chunks.size() * sizeof(RecipeEntry);
+}
+
+bool ChunkStore::write_recipe(const std::string& path, const Recipe& recipe) {
+    std::string buffer;
+    buffer.reserve(recipe_bytes(recipe));
+    RecipeHeader header{};
+    std::memcpy(header.magic, RecipeMagic, sizeof(RecipeMagic));
+    header.size = recipe.size;
+    header.count = recipe.chunks.size();
+    buffer.append(reinterpret_cast<const char*>(&header), sizeof(header));
+    for (const auto& chunk : recipe.chunks) {
+        RecipeEntry entry{};
+        if (!from_hex(chunk.hash, entry.hash, HashBytes)) return false;
+        entry.length = chunk.length;
+        buffer.append(reinterpret_cast<const char*>(&entry), sizeof(entry));
+    }
+    return write_file(path, buffer.data(), buffer.size());
+}
+
+bool ChunkStore::read_recipe(int fd, Recipe& recipe) {
+    struct stat st;
+    RecipeHeader header;
+    if (::fstat(fd, &st) != 0 || st.st_size < static_cast<off_t>(sizeof(header))) return false;
+    if (::pread(fd, &header, sizeof(header), 0) != sizeof(header)) return false;
+    if (std::memcmp(header.magic, RecipeMagic, sizeof(RecipeMagic)) != 0) return false;
+    if (static_cast<uint64_t>(st.st_size) != sizeof(header) + header.count * sizeof(RecipeEntry)) return false;
+
+    std::vector<RecipeEntry> entries(header.count);
+    size_t entries_len = header.count * sizeof(RecipeEntry);
+    if (::pread(fd, entries.data(), entries_len, sizeof(header)) != static_cast<ssize_t>(entries_len)) return false;
+
+    recipe.size = header.size;
+    recipe.chunks.clear();
+    uint64_t total = 0;
+    for (const auto& entry : entries) {
+        recipe.chunks.push_back(ChunkRef{to_hex(entry.hash, HashBytes), entry.length});
+        total += entry.length;
+    }
+    return total == recipe.size;
+}
@@ -0,0 +1,79 @@
+#pragma once
+#include <array>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+struct ChunkRef {
+    std::string hash;   // hex SHA-256 of the chunk
+    uint32_t length;
+};
+
+// How to rebuild an object from its chunks. Stored in place of the object
+// at cache_dir/<key> in dedup mode.
+struct Recipe {
+    uint64_t size = 0;
+    std::vector<ChunkRef> chunks;
+};
+
+// Content-addressed chunk files under cache_dir/.chunks, each stored once
+// and reference counted by the recipes that use it. A chunk whose last
+// reference goes away is deleted, unless a reader still has it pinned; then
+// it goes when the last reader lets go.
+class ChunkStore {
+public:
+    explicit ChunkStore(const std::string& cache_dir);
+
+    // Adds a reference to the chunk, writing it first if it is not stored.
+    // Returns the bytes this added to the disk.
+    size_t put(const std::string& hash, const char* data, size_t len);
+
+    // Adds references for a recipe found on disk at startup, setting
+    // added_bytes to the chunk bytes it is the first to account for. Returns
+    // false if one of its chunks is missing.
+    bool add_refs(const Recipe& recipe, size_t& added_bytes);
+
+    // Drops the recipe's references. Returns the bytes freed.
+    size_t release(const Recipe& recipe);
+
+    // Readers pin a recipe's chunks so eviction cannot delete them mid-read.
+    void pin(const Recipe& recipe);
+    void unpin(const Recipe& recipe);
+
+    bool contains(const std::string& hash);
+    // Re-hashes a stored chunk. A chunk that no longer matches its hash is
+    // deleted and written again by the next put() of the same content.
+    bool verify(const std::string& hash);
+    // Deletes a file under .chunks that no recipe accounts for, such as one
+    // left by a crash. Returns true if it was removed.
+    bool remove_orphan(const std::string& file_name);
+    std::string chunk_path(const std::string& hash) const;
+
+    static std::string hash_chunk(const char* data, size_t len);
+    static bool write_recipe(const std::string& path, const Recipe& recipe);
+    static bool read_recipe(int fd, Recipe& recipe);
+    static size_t recipe_bytes(const Recipe& recipe);
+
+private:
+    struct Chunk {
+        uint32_t refs = 0;
+        uint32_t readers = 0;
+        uint32_t size = 0;
+        bool damaged = false;   // file deleted by verify(), awaiting a rewrite
+    };
+
+    // Striped by hash so concurrent fills rarely contend
+    struct Stripe {
+        std::mutex mutex;
+        std::unordered_map<std::string, Chunk> chunks;
+    };
+
+    std::string dir_;
+    std::array<Stripe, 64> stripes_;
+
+    Stripe& stripe_for(const std::string& hash);
+    void write_chunk(const std::string& hash, const char* data, size_t len);
+    void remove_if_unused(Stripe& stripe, const std::string& hash);
+};
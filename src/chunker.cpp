@@ -0,0 +1,63 @@
+#include "chunker.h"
+#include <array>
+
+namespace {
+
+// 256 fixed pseudo-random values, one per byte value. They have to stay the
+// same across restarts, or the chunks of a refilled object would stop
+// matching the ones already stored.
+std::array<uint64_t, 256> make_gear_table() {
+    std::array<uint64_t, 256> table{};
+    uint64_t state = 0x9E3779B97F4A7C15ULL;
+    for (auto& value : table) {
+        // splitmix64
+        uint64_t z = (state += 0x9E3779B97F4A7C15ULL);
+        z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+        z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+        value = z ^ (z >> 31);
+    }
+    return table;
+}
+
+const std::array<uint64_t, 256> Gear = make_gear_table();
+
+// A mask with bits set bits spread over the upper 48 bits of the hash,
+// which mix in the most bytes
+uint64_t spread_mask(int bits) {
+    uint64_t mask = 0;
+    for (int i = 0; i < bits; ++i) mask |= uint64_t(1) << (63 - i * 48 / bits);
+    return mask;
+}
+
+int log2_floor(size_t n) {
+    int bits = 0;
+    while (n >>= 1) ++bits;
+    return bits;
+}
+
+}  // namespace
+
+Chunker::Chunker(size_t min_size, size_t avg_size, size_t max_size)
+    : min_size_(min_size), avg_size_(avg_size), max_size_(max_size) {
+    int bits = log2_floor(avg_size);
+    mask_small_ = spread_mask(bits + 2);
+    mask_large_ = spread_mask(bits - 2);
+}
+
+size_t Chunker::next_cut(const uint8_t* data, size_t len) const {
+    if (len <= min_size_) return len;
+    size_t end = len < max_size_ ? len : max_size_;
+    size_t normal = len < avg_size_ ? len : avg_size_;
+
+    uint64_t hash = 0;
+    size_t i = min_size_;
+    for (; i < normal; ++i) {
+        hash = (hash << 1) + Gear[data[i]];
+        if (!(hash & mask_small_)) return i + 1;
+    }
+    for (; i < end; ++i) {
+        hash = (hash << 1) + Gear[data[i]];
+        if (!(hash & mask_large_)) return i + 1;
+    }
+    return end;
+}
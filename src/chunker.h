@@ -0,0 +1,27 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+
+// FastCDC content-defined chunking. Cut points depend only on the bytes
+// around them, so an insert or delete early in an object shifts a chunk or
+// two instead of every fixed-size block after it, and near-identical
+// objects share most of their chunks.
+//
+// Uses the gear rolling hash with normalized chunking: a stricter mask
+// before the average size and a looser one after keeps chunk sizes close to
+// the average, and the first min_size bytes of a chunk are skipped
+// outright.
+class Chunker {
+public:
+    Chunker(size_t min_size, size_t avg_size, size_t max_size);
+
+    // Length of the chunk starting at data, at most len.
+    size_t next_cut(const uint8_t* data, size_t len) const;
+
+private:
+    size_t min_size_;
+    size_t avg_size_;
+    size_t max_size_;
+    uint64_t mask_small_;   // used before avg_size: more bits, cuts less likely
+    uint64_t mask_large_;   // used after avg_size: fewer bits, cuts more likely
+};
@@ -1,13 +1,49 @@
 #include "cli_utils.h"
 #include "cxxopts.hpp"
 #include "ini.h"
+#include <algorithm>
 #include <iostream>
+#include <map>
+#include <set>
 
 struct IniConfig {
     std::string endpoint = "http://localhost:4443";
     std::string cache_dir = "./cache";
     size_t max_disk = 500;
     size_t max_ram = 64;
+    size_t shards = 8;
+    size_t block_size = 0;
+    std::string eviction_policy = "lru";
+    std::string eviction_cost = "objects";
+    std::string admission = "tinylfu";
+    size_t admission_window = 1;
+    size_t parallel_fill_min = 64;
+    size_t parallel_part = 16;
+    size_t parallel_streams = 4;
+    size_t readahead = 8;
+    size_t readahead_budget = 64;
+    size_t warmup_concurrency = 8;
+    size_t manifest_window = 4;
+    std::string dedup = "off";
+    size_t scrub_rate = 16;
+    std::string consistency = "ttl";
+    size_t ttl = 300;
+    size_t negative_ttl = 5;
+    size_t evict_high = 95;
+    size_t evict_low = 85;
+    std::string io_backend = "io_uring";
+    size_t direct_io_min = 64;
+    std::string compression = "off";
+    int compression_level = 3;
+    // [bucket:<name>] sections override consistency, ttl and compression per bucket
+    std::map<std::string, std::map<std::string, std::string>> buckets;
+    size_t ram_tier = 16;
+    std::string huge_pages = "off";
+    size_t client_ram_max = 50;
+    size_t client_ram_min = 10;
+    size_t bucket_ram_max = 100;
+    size_t bucket_ram_min = 0;
+    size_t ram_object_max = 1024;
     size_t max_concurrency = 2;
     size_t max_bandwidth = 10;
 };
@@ -22,6 +58,39 @@ static int ini_cfg_reader(void* user, const char* section, const char* name, con
         if (key == "cache_dir") config->cache_dir = value;
         else if (key == "max_disk") config->max_disk = std::stoul(value);
         else if (key == "max_ram") config->max_ram = std::stoul(value);
+        else if (key == "ram_tier") config->ram_tier = std::stoul(value);
+        else if (key == "huge_pages") config->huge_pages = value;
+        else if (key == "client_ram_max") config->client_ram_max = std::min<size_t>(100, std::stoul(value));
+        else if (key == "client_ram_min") config->client_ram_min = std::min<size_t>(100, std::stoul(value));
+        else if (key == "bucket_ram_max") config->bucket_ram_max = std::min<size_t>(100, std::stoul(value));
+        else if (key == "bucket_ram_min") config->bucket_ram_min = std::min<size_t>(100, std::stoul(value));
+        else if (key == "ram_object_max") config->ram_object_max = std::stoul(value);
+        else if (key == "eviction_policy") config->eviction_policy = value;
+        else if (key == "eviction_cost") config->eviction_cost = value;
+        else if (key == "admission") config->admission = value;
+        else if (key == "admission_window") config->admission_window = std::min<size_t>(100, std::stoul(value));
+        else if (key == "block_size") config->block_size = std::stoul(value);
+        else if (key == "shards") config->shards = std::max<size_t>(1, std::stoul(value));
+        else if (key == "parallel_fill_min") config->parallel_fill_min = std::stoul(value);
+        else if (key == "parallel_part") config->parallel_part = std::max<size_t>(1, std::stoul(value));
+        else if (key == "parallel_streams") config->parallel_streams = std::max<size_t>(1, std::stoul(value));
+        else if (key == "readahead") config->readahead = std::stoul(value);
+        else if (key == "readahead_budget") config->readahead_budget = std::stoul(value);
+        else if (key == "warmup_concurrency") config->warmup_concurrency = std::max<size_t>(1, std::stoul(value));
+        else if (key == "manifest_window") config->manifest_window = std::max<size_t>(1, std::stoul(value));
+        else if (key == "dedup") config->dedup = value;
+        else if (key == "scrub_rate") config->scrub_rate = std::stoul(value);
+        else if (key == "consistency") config->consistency = value;
+        else if (key == "ttl") config->ttl = std::stoul(value);
+        else if (key == "negative_ttl") config->negative_ttl = std::stoul(value);
+        else if (key == "evict_high") config->evict_high = std::min<size_t>(100, std::stoul(value));
+        else if (key == "evict_low") config->evict_low = std::min<size_t>(100, std::stoul(value));
+        else if (key == "io_backend") config->io_backend = value;
+        else if (key == "direct_io_min") config->direct_io_min = std::stoul(value);
+        else if (key == "compression") config->compression = value;
+        else if (key == "compression_level") config->compression_level = std::max(1, std::stoi(value));
+    } else if (sec.compare(0, 7, "bucket:") == 0) {
+        config->buckets[sec.substr(7)][key] = value;
     } else if (sec == "qos") {
         if (key == "max_concurrency") config->max_concurrency = std::stoul(value);
         else if (key == "max_bandwidth") config->max_bandwidth = std::stoul(value);
@@ -52,6 +121,48 @@ CliConfig parse_cli(int argc, char* argv[]) {
         }
     }
 
+    const std::set<std::string> policies = {"lru", "s3fifo", "arc", "gdsf"};
+    if (!policies.count(ini_cfg.eviction_policy)) {
+        std::cerr << "Unknown eviction_policy: " << ini_cfg.eviction_policy << " (expected lru, s3fifo, arc or gdsf)\n";
+        exit(1);
+    }
+
+    const std::set<std::string> modes = {"immutable", "ttl", "strong"};
+    std::unordered_map<std::string, ConsistencyConfig> bucket_consistency;
+    for (const auto& [bucket, settings] : ini_cfg.buckets) {
+        auto mode = settings.find("consistency");
+        auto ttl = settings.find("ttl");
+        bucket_consistency[bucket] = ConsistencyConfig{
+            mode != settings.end() ? mode->second : ini_cfg.consistency,
+            ttl != settings.end() ? std::stoul(ttl->second) : ini_cfg.ttl};
+    }
+    bucket_consistency[""] = ConsistencyConfig{ini_cfg.consistency, ini_cfg.ttl};
+    for (const auto& [bucket, consistency] : bucket_consistency) {
+        if (!modes.count(consistency.mode)) {
+            std::cerr << "Unknown consistency" << (bucket.empty() ? "" : " for bucket " + bucket) << ": "
+                      << consistency.mode << " (expected immutable, ttl or strong)\n";
+            exit(1);
+        }
+    }
+    bucket_consistency.erase("");
+
+    const std::set<std::string> codecs = {"off", "zstd"};
+    std::unordered_map<std::string, std::string> bucket_codecs;
+    for (const auto& [bucket, settings] : ini_cfg.buckets) {
+        auto codec = settings.find("compression");
+        bucket_codecs[bucket] = codec != settings.end() ? codec->second : ini_cfg.compression;
+    }
+    bucket_codecs[""] = ini_cfg.compression;
+    std::unordered_map<std::string, bool> bucket_compression;
+    for (const auto& [bucket, codec] : bucket_codecs) {
+        if (!codecs.count(codec)) {
+            std::cerr << "Unknown compression" << (bucket.empty() ? "" : " for bucket " + bucket) << ": "
+                      << codec << " (expected off or zstd)\n";
+            exit(1);
+        }
+        if (!bucket.empty()) bucket_compression[bucket] = codec == "zstd";
+    }
+
     if (result.count("endpoint"))
         ini_cfg.endpoint = result["endpoint"].as<std::string>();
 
@@ -59,7 +170,39 @@ CliConfig parse_cli(int argc, char* argv[]) {
         .config = {
             .max_disk_cache_size = ini_cfg.max_disk * 1024 * 1024,
             .max_ram_usage = ini_cfg.max_ram * 1024 * 1024,
+            .ram_tier_size = std::min(ini_cfg.ram_tier, ini_cfg.max_ram) * 1024 * 1024,
+            .ram_object_max = ini_cfg.ram_object_max * 1024,
+            .huge_pages = ini_cfg.huge_pages == "on",
+            .client_ram_max = ini_cfg.max_ram * 1024 * 1024 / 100 * ini_cfg.client_ram_max,
+            .client_ram_min = ini_cfg.max_ram * 1024 * 1024 / 100 * ini_cfg.client_ram_min,
+            .bucket_ram_max = ini_cfg.max_ram * 1024 * 1024 / 100 * ini_cfg.bucket_ram_max,
+            .bucket_ram_min = ini_cfg.max_ram * 1024 * 1024 / 100 * ini_cfg.bucket_ram_min,
             .cache_dir = ini_cfg.cache_dir,
+            .cache_shards = ini_cfg.shards,
+            .block_size = ini_cfg.block_size * 1024 * 1024,
+            .eviction_policy = ini_cfg.eviction_policy,
+            .eviction_byte_hit_ratio = ini_cfg.eviction_cost == "bytes",
+            .admission_enabled = ini_cfg.admission == "tinylfu",
+            .admission_window_pct = ini_cfg.admission_window,
+            .parallel_fill_min = ini_cfg.parallel_fill_min * 1024 * 1024,
+            .parallel_part_size = ini_cfg.parallel_part * 1024 * 1024,
+            .parallel_streams = ini_cfg.parallel_streams,
+            .readahead_blocks = ini_cfg.readahead,
+            .readahead_budget = ini_cfg.readahead_budget * 1024 * 1024,
+            .warmup_concurrency = ini_cfg.warmup_concurrency,
+            .manifest_window = ini_cfg.manifest_window,
+            .dedup = ini_cfg.dedup == "on",
+            .scrub_rate = ini_cfg.scrub_rate * 1024 * 1024,
+            .consistency = {ini_cfg.consistency, ini_cfg.ttl},
+            .bucket_consistency = std::move(bucket_consistency),
+            .negative_ttl_sec = ini_cfg.negative_ttl,
+            .evict_high_watermark = ini_cfg.max_disk * 1024 * 1024 / 100 * ini_cfg.evict_high,
+            .evict_low_watermark = ini_cfg.max_disk * 1024 * 1024 / 100 * std::min(ini_cfg.evict_low, ini_cfg.evict_high),
+            .io_uring = ini_cfg.io_backend == "io_uring",
+            .direct_io_min = ini_cfg.direct_io_min * 1024 * 1024,
+            .compression = ini_cfg.compression == "zstd",
+            .bucket_compression = std::move(bucket_compression),
+            .compression_level = ini_cfg.compression_level,
             .gcs_endpoint = ini_cfg.endpoint,
         },
         .qos = {
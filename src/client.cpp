@@ -2,8 +2,8 @@
 #include "gcs_cache.h"
 #include <thread>
 
-Client::Client(GCSCache* cache, const QosConfig& qos)
-    : cache_(cache), qos_(qos), concurrent_requests_(0) {}
+Client::Client(GCSCache* cache, const std::string& client_id, const QosConfig& qos)
+    : cache_(cache), client_id_(client_id), qos_(qos), concurrent_requests_(0) {}
 
 void Client::wait_for_slot() {
     std::unique_lock<std::mutex> lock(qos_mutex_);
@@ -15,13 +15,24 @@ void Client::wait_for_slot() {
     ++concurrent_requests_;
 }
 
-std::string Client::get_object(const std::string& file, const std::string& bucket) {
+std::shared_ptr<ObjectReader> Client::get_object(const std::string& file, const std::string& bucket,
+                                                 int64_t generation, bool accept_zstd) {
     wait_for_slot();
-    auto path = cache_->get_or_fetch_object(file, bucket);
+    auto reader = cache_->get_or_fetch_object(file, bucket, client_id_, generation, accept_zstd);
     {
         std::lock_guard<std::mutex> lock(qos_mutex_);
         --concurrent_requests_;
     }
-    return path;
+    return reader;
 }
 
+std::shared_ptr<ObjectReader> Client::get_object_for_range(const std::string& file, const std::string& bucket,
+                                                           int64_t generation) {
+    wait_for_slot();
+    auto reader = cache_->get_object_for_range(file, bucket, client_id_, generation);
+    {
+        std::lock_guard<std::mutex> lock(qos_mutex_);
+        --concurrent_requests_;
+    }
+    return reader;
+}
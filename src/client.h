@@ -1,16 +1,23 @@
 #pragma once
 #include "config.h"
+#include "object_reader.h"
+#include <cstdint>
+#include <memory>
 #include <mutex>
 
 class GCSCache;
 
 class Client {
 public:
-    Client(GCSCache* cache, const QosConfig& qos);
-    std::string get_object(const std::string& file, const std::string& bucket);
+    Client(GCSCache* cache, const std::string& client_id, const QosConfig& qos);
+    std::shared_ptr<ObjectReader> get_object(const std::string& file, const std::string& bucket, int64_t generation = 0,
+                                             bool accept_zstd = false);
+    std::shared_ptr<ObjectReader> get_object_for_range(const std::string& file, const std::string& bucket,
+                                                       int64_t generation = 0);
 
 private:
     GCSCache* cache_;
+    std::string client_id_;
     QosConfig qos_;
     std::mutex qos_mutex_;
     size_t concurrent_requests_;
@@ -1,15 +1,56 @@
 #pragma once
 #include <string>
+#include <unordered_map>
 
 struct QosConfig {
     size_t max_concurrent_requests;
     size_t max_bandwidth_bps;
 };
 
+// How cached objects of a bucket are kept in step with GCS: immutable
+// never rechecks, ttl rechecks once ttl_sec has passed since the last
+// check, strong rechecks on every request.
+struct ConsistencyConfig {
+    std::string mode;
+    size_t ttl_sec;
+};
+
 struct Config {
     size_t max_disk_cache_size;
     size_t max_ram_usage;
+    size_t ram_tier_size;
+    size_t ram_object_max;
+    bool huge_pages;
+    size_t client_ram_max;          // bytes of max_ram one client's streams may hold; 0 for no cap
+    size_t client_ram_min;          // and are guaranteed, borrowing back from others
+    size_t bucket_ram_max;          // the same per bucket
+    size_t bucket_ram_min;
     std::string cache_dir;
+    size_t cache_shards;
+    size_t block_size;
+    std::string eviction_policy;
+    bool eviction_byte_hit_ratio;
+    bool admission_enabled;
+    size_t admission_window_pct;
+    size_t parallel_fill_min;
+    size_t parallel_part_size;
+    size_t parallel_streams;
+    size_t readahead_blocks;
+    size_t readahead_budget;
+    size_t warmup_concurrency;
+    size_t manifest_window;
+    bool dedup;
+    size_t scrub_rate;
+    ConsistencyConfig consistency;
+    std::unordered_map<std::string, ConsistencyConfig> bucket_consistency;
+    size_t negative_ttl_sec;
+    size_t evict_high_watermark;    // bytes; the background evictor starts past this
+    size_t evict_low_watermark;     // and stops here
+    bool io_uring;
+    size_t direct_io_min;
+    bool compression;               // zstd on disk
+    std::unordered_map<std::string, bool> bucket_compression;
+    int compression_level;          // with the CPUs idle; lowered as they get busy
 
     std::string gcs_endpoint;
 };
@@ -0,0 +1,102 @@
+#include "crc32c.h"
+#include <array>
+#include <cstring>
+#if defined(__x86_64__)
+#include <nmmintrin.h>
+#endif
+
+namespace {
+
+constexpr uint32_t Polynomial = 0x82f63b78;   // reflected Castagnoli
+
+std::array<uint32_t, 256> make_table() {
+    std::array<uint32_t, 256> table{};
+    for (uint32_t i = 0; i < 256; ++i) {
+        uint32_t crc = i;
+        for (int bit = 0; bit < 8; ++bit) crc = (crc >> 1) ^ (crc & 1 ? Polynomial : 0);
+        table[i] = crc;
+    }
+    return table;
+}
+
+uint32_t update_table(uint32_t crc, const unsigned char* data, size_t len) {
+    static const std::array<uint32_t, 256> table = make_table();
+    for (size_t i = 0; i < len; ++i) crc = table[(crc ^ data[i]) & 0xff] ^ (crc >> 8);
+    return crc;
+}
+
+#if defined(__x86_64__)
+__attribute__((target("sse4.2")))
+uint32_t update_sse42(uint32_t crc, const unsigned char* data, size_t len) {
+    uint64_t crc64 = crc;
+    while (len >= 8) {
+        uint64_t word;
+        std::memcpy(&word, data, sizeof(word));
+        crc64 = _mm_crc32_u64(crc64, word);
+        data += 8;
+        len -= 8;
+    }
+    crc = static_cast<uint32_t>(crc64);
+    while (len > 0) {
+        crc = _mm_crc32_u8(crc, *data++);
+        --len;
+    }
+    return crc;
+}
+
+const bool has_sse42 = __builtin_cpu_supports("sse4.2");
+#endif
+
+int base64_value(char c) {
+    if (c >= 'A' && c <= 'Z') return c - 'A';
+    if (c >= 'a' && c <= 'z') return c - 'a' + 26;
+    if (c >= '0' && c <= '9') return c - '0' + 52;
+    if (c == '+') return 62;
+    if (c == '/') return 63;
+    return -1;
+}
+
+}  // namespace
+
+void Crc32c::update(const char* data, size_t len) {
+    auto* bytes = reinterpret_cast<const unsigned char*>(data);
+#if defined(__x86_64__)
+    if (has_sse42) {
+        state_ = update_sse42(state_, bytes, len);
+        return;
+    }
+#endif
+    state_ = update_table(state_, bytes, len);
+}
+
+uint32_t Crc32c::compute(const char* data, size_t len) {
+    Crc32c crc;
+    crc.update(data, len);
+    return crc.value();
+}
+
+std::optional<uint32_t> Crc32c::from_hash_header(const std::string& header) {
+    const std::string prefix = "crc32c=";
+    size_t pos = header.find(prefix);
+    if (pos == std::string::npos) return std::nullopt;
+    pos += prefix.size();
+
+    // 4 bytes, big-endian, base64 encoded as 8 characters with padding
+    uint64_t bits = 0;
+    int decoded = 0;
+    for (; pos < header.size() && decoded < 6; ++pos, ++decoded) {
+        int value = base64_value(header[pos]);
+        if (value < 0) break;
+        bits = bits << 6 | value;
+    }
+    if (decoded != 6) return std::nullopt;
+    return static_cast<uint32_t>(bits >> 4);
+}
+
+std::string Crc32c::to_base64(uint32_t crc) {
+    static const char digits[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+    uint64_t bits = static_cast<uint64_t>(crc) << 4;
+    std::string encoded;
+    for (int shift = 30; shift >= 0; shift -= 6) encoded += digits[(bits >> shift) & 63];
+    return encoded + "==";
+}
@@ -0,0 +1,24 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <string>
+
+// CRC32C (Castagnoli), the checksum GCS keeps for every object. Uses the
+// SSE4.2 crc32 instruction when the CPU has it and a table otherwise.
+class Crc32c {
+public:
+    void update(const char* data, size_t len);
+    uint32_t value() const { return ~state_; }
+
+    static uint32_t compute(const char* data, size_t len);
+
+    // The crc32c GCS reports in an x-goog-hash style list such as
+    // "crc32c=n03x6A==,md5=...", if it has one.
+    static std::optional<uint32_t> from_hash_header(const std::string& header);
+    // The reverse: crc as GCS writes it, base64 of its big-endian bytes
+    static std::string to_base64(uint32_t crc);
+
+private:
+    uint32_t state_ = ~0u;
+};
@@ -0,0 +1,42 @@
+#include "deletion_queue.h"
+#include <cerrno>
+#include <cstring>
+#include <glog/logging.h>
+#include <unistd.h>
+
+DeletionQueue::DeletionQueue()
+    : thread_(&DeletionQueue::run, this) {}
+
+DeletionQueue::~DeletionQueue() {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stopping_ = true;
+    }
+    cond_.notify_all();
+    thread_.join();
+}
+
+void DeletionQueue::push(std::string path) {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        paths_.push_back(std::move(path));
+    }
+    cond_.notify_one();
+}
+
+void DeletionQueue::run() {
+    while (true) {
+        std::deque<std::string> batch;
+        {
+            std::unique_lock<std::mutex> lock(mutex_);
+            cond_.wait(lock, [&] { return stopping_ || !paths_.empty(); });
+            if (paths_.empty()) return;
+            batch.swap(paths_);
+        }
+        for (const auto& path : batch) {
+            if (::unlink(path.c_str()) != 0 && errno != ENOENT) {
+                LOG(WARNING) << "[EVICT] Failed to delete " << path << ": " << std::strerror(errno) << "\n";
+            }
+        }
+    }
+}
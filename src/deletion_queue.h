@@ -0,0 +1,29 @@
+#pragma once
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+
+// Unlinks files on a background thread, so evicting many entries does not
+// put a burst of unlink calls on a request's path. Whatever is still
+// queued is deleted before destruction returns.
+class DeletionQueue {
+public:
+    DeletionQueue();
+    ~DeletionQueue();
+
+    DeletionQueue(const DeletionQueue&) = delete;
+    DeletionQueue& operator=(const DeletionQueue&) = delete;
+
+    void push(std::string path);
+
+private:
+    std::mutex mutex_;
+    std::condition_variable cond_;
+    std::deque<std::string> paths_;
+    bool stopping_ = false;
+    std::thread thread_;
+
+    void run();
+};
@@ -0,0 +1,294 @@
+#include "eviction_policy.h"
+#include <algorithm>
+#include <stdexcept>
+
+// LRU
+
+void LruPolicy::on_erase(const std::string& key) {
+    auto it = index_.find(key);
+    if (it == index_.end()) return;
+    keys_.erase(it->second);
+    index_.erase(it);
+}
+
+bool LruPolicy::peek_victim(std::string& key) const {
+    if (keys_.empty()) return false;
+    key = keys_.back();
+    return true;
+}
+
+bool LruPolicy::evict(std::string& key) {
+    if (!peek_victim(key)) return false;
+    index_.erase(key);
+    keys_.pop_back();
+    return true;
+}
+
+void LruPolicy::for_each(const KeyVisitor& fn) const {
+    for (auto it = keys_.rbegin(); it != keys_.rend(); ++it) fn(*it);
+}
+
+// S3-FIFO
+
+void S3FifoPolicy::on_insert(const std::string& key, size_t size) {
+    auto ghost = ghost_index_.find(key);
+    bool returning = ghost != ghost_index_.end();
+    if (returning) {
+        ghost_.erase(ghost->second);
+        ghost_index_.erase(ghost);
+    }
+
+    auto& queue = returning ? main_ : small_;
+    queue.push_front(key);
+    index_[key] = Entry{queue.begin(), size, 0, !returning};
+    if (!returning) small_bytes_ += size;
+    total_bytes_ += size;
+    victim_valid_ = false;
+}
+
+void S3FifoPolicy::on_erase(const std::string& key) {
+    auto it = index_.find(key);
+    if (it == index_.end()) return;
+    if (it->second.in_small) {
+        small_.erase(it->second.it);
+        small_bytes_ -= it->second.size;
+    } else {
+        main_.erase(it->second.it);
+    }
+    total_bytes_ -= it->second.size;
+    index_.erase(it);
+    victim_valid_ = false;
+}
+
+// The small queue is meant to hold about 10% of the bytes.
+bool S3FifoPolicy::evict_from_small() const {
+    return !small_.empty() && (main_.empty() || small_bytes_ * 10 >= total_bytes_);
+}
+
+// Follows evict's walk without moving anything. Small-queue entries hit
+// more than once would be promoted to main with no hits; main entries would
+// be rotated, losing a hit each time round, until one has none left, which
+// is the oldest of those with the fewest hits. The answer is kept until
+// something changes it, so repeated peeks between evictions cost nothing.
+bool S3FifoPolicy::peek_victim(std::string& key) const {
+    if (victim_valid_) {
+        key = victim_;
+        return true;
+    }
+    size_t small_bytes = small_bytes_;
+    const std::string* promoted = nullptr;    // the first one, oldest in main
+    for (auto it = small_.rbegin(); it != small_.rend(); ++it) {
+        bool main_empty = main_.empty() && !promoted;
+        if (!main_empty && small_bytes * 10 < total_bytes_) break;
+        const Entry& entry = index_.at(*it);
+        if (entry.freq <= 1) {
+            victim_ = key = *it;
+            victim_valid_ = true;
+            return true;
+        }
+        small_bytes -= entry.size;
+        if (!promoted) promoted = &*it;
+    }
+
+    const std::string* victim = nullptr;
+    uint8_t fewest = 0;
+    for (auto it = main_.rbegin(); it != main_.rend(); ++it) {
+        uint8_t freq = index_.at(*it).freq;
+        if (!victim || freq < fewest) {
+            victim = &*it;
+            fewest = freq;
+            // Nothing further from the tail can beat the oldest with no hits
+            if (freq == 0) break;
+        }
+    }
+    if (promoted && (!victim || fewest > 0)) victim = promoted;
+    if (!victim) return false;
+    victim_ = key = *victim;
+    victim_valid_ = true;
+    return true;
+}
+
+bool S3FifoPolicy::evict(std::string& key) {
+    victim_valid_ = false;
+    while (!small_.empty() || !main_.empty()) {
+        if (evict_from_small()) {
+            std::string tail = small_.back();
+            Entry& entry = index_.at(tail);
+            small_bytes_ -= entry.size;
+            if (entry.freq > 1) {
+                main_.splice(main_.begin(), small_, entry.it);
+                entry.in_small = false;
+                entry.freq = 0;
+                continue;
+            }
+            small_.pop_back();
+            total_bytes_ -= entry.size;
+            index_.erase(tail);
+            remember_ghost(tail);
+            key = tail;
+            return true;
+        }
+
+        std::string tail = main_.back();
+        Entry& entry = index_.at(tail);
+        if (entry.freq > 0) {
+            --entry.freq;
+            main_.splice(main_.begin(), main_, entry.it);
+            continue;
+        }
+        main_.pop_back();
+        total_bytes_ -= entry.size;
+        index_.erase(tail);
+        key = tail;
+        return true;
+    }
+    return false;
+}
+
+void S3FifoPolicy::remember_ghost(const std::string& key) {
+    ghost_.push_front(key);
+    ghost_index_[key] = ghost_.begin();
+    size_t limit = std::max<size_t>(main_.size(), 16);
+    while (ghost_.size() > limit) {
+        ghost_index_.erase(ghost_.back());
+        ghost_.pop_back();
+    }
+}
+
+void S3FifoPolicy::for_each(const KeyVisitor& fn) const {
+    for (const auto* queue : {&small_, &main_}) {
+        for (auto it = queue->rbegin(); it != queue->rend(); ++it) fn(*it);
+    }
+}
+
+// ARC
+
+void ArcPolicy::on_insert(const std::string& key, size_t) {
+    double capacity = static_cast<double>(t1_.size() + t2_.size() + 1);
+    bool seen_before = false;
+
+    auto b1 = b1_index_.find(key);
+    if (b1 != b1_index_.end()) {
+        // Evicted from T1 too early: grow T1's share
+        p_ = std::min(capacity, p_ + std::max(1.0, double(b2_.size()) / b1_.size()));
+        b1_.erase(b1->second);
+        b1_index_.erase(b1);
+        seen_before = true;
+    }
+    auto b2 = b2_index_.find(key);
+    if (b2 != b2_index_.end()) {
+        // Evicted from T2 too early: shrink T1's share
+        p_ = std::max(0.0, p_ - std::max(1.0, double(b1_.size()) / b2_.size()));
+        b2_.erase(b2->second);
+        b2_index_.erase(b2);
+        seen_before = true;
+    }
+
+    auto& list = seen_before ? t2_ : t1_;
+    list.push_front(key);
+    index_[key] = Entry{list.begin(), !seen_before};
+}
+
+void ArcPolicy::on_erase(const std::string& key) {
+    auto it = index_.find(key);
+    if (it == index_.end()) return;
+    (it->second.in_t1 ? t1_ : t2_).erase(it->second.it);
+    index_.erase(it);
+}
+
+bool ArcPolicy::evict_from_t1() const {
+    return !t1_.empty() && (t2_.empty() || t1_.size() > p_);
+}
+
+bool ArcPolicy::peek_victim(std::string& key) const {
+    if (t1_.empty() && t2_.empty()) return false;
+    key = evict_from_t1() ? t1_.back() : t2_.back();
+    return true;
+}
+
+bool ArcPolicy::evict(std::string& key) {
+    if (t1_.empty() && t2_.empty()) return false;
+    bool from_t1 = evict_from_t1();
+    auto& list = from_t1 ? t1_ : t2_;
+    auto& ghosts = from_t1 ? b1_ : b2_;
+    auto& ghost_index = from_t1 ? b1_index_ : b2_index_;
+
+    key = list.back();
+    list.pop_back();
+    index_.erase(key);
+    ghosts.push_front(key);
+    ghost_index[key] = ghosts.begin();
+    trim_ghosts();
+    return true;
+}
+
+// Each ghost list remembers at most as many keys as are resident.
+void ArcPolicy::trim_ghosts() {
+    size_t limit = std::max<size_t>(t1_.size() + t2_.size(), 16);
+    while (b1_.size() > limit) {
+        b1_index_.erase(b1_.back());
+        b1_.pop_back();
+    }
+    while (b2_.size() > limit) {
+        b2_index_.erase(b2_.back());
+        b2_.pop_back();
+    }
+}
+
+void ArcPolicy::for_each(const KeyVisitor& fn) const {
+    for (const auto* list : {&t1_, &t2_}) {
+        for (auto it = list->rbegin(); it != list->rend(); ++it) fn(*it);
+    }
+}
+
+// GDSF
+
+void GdsfPolicy::on_insert(const std::string& key, size_t size) {
+    auto [it, inserted] = index_.try_emplace(key, Entry{by_priority_.end(), size, 1});
+    if (!inserted) {
+        it->second.size = size;
+        it->second.freq = 1;
+    }
+    reprioritize(it->first, it->second);
+}
+
+void GdsfPolicy::reprioritize(const std::string& key, Entry& entry) {
+    if (entry.it != by_priority_.end()) by_priority_.erase(entry.it);
+    double cost_per_byte = byte_hit_ratio_ ? 1.0 : 1.0 / std::max<size_t>(entry.size, 1);
+    entry.it = by_priority_.emplace(clock_ + entry.freq * cost_per_byte, key);
+}
+
+void GdsfPolicy::on_erase(const std::string& key) {
+    auto it = index_.find(key);
+    if (it == index_.end()) return;
+    by_priority_.erase(it->second.it);
+    index_.erase(it);
+}
+
+bool GdsfPolicy::peek_victim(std::string& key) const {
+    if (by_priority_.empty()) return false;
+    key = by_priority_.begin()->second;
+    return true;
+}
+
+bool GdsfPolicy::evict(std::string& key) {
+    if (by_priority_.empty()) return false;
+    auto victim = by_priority_.begin();
+    clock_ = victim->first;
+    key = victim->second;
+    index_.erase(key);
+    by_priority_.erase(victim);
+    return true;
+}
+
+void GdsfPolicy::for_each(const KeyVisitor& fn) const {
+    for (const auto& [priority, key] : by_priority_) fn(key);
+}
+
+EvictionPolicy make_eviction_policy(const std::string& name, bool byte_hit_ratio) {
+    if (name == "lru") return LruPolicy();
+    if (name == "s3fifo") return S3FifoPolicy();
+    if (name == "arc") return ArcPolicy();
+    if (name == "gdsf") return GdsfPolicy(byte_hit_ratio);
+    throw std::invalid_argument("Unknown eviction policy: " + name);
+}
@@ -0,0 +1,176 @@
+#pragma once
+#include <cstdint>
+#include <functional>
+#include <list>
+#include <map>
+#include <string>
+#include <unordered_map>
+#include <variant>
+
+// Eviction policies for the main segment of a CacheShard. They share no base
+// class: CacheShard holds them in a std::variant and dispatches with
+// std::visit, so the calls on the hit path are resolved at compile time and
+// inlined. Each policy provides
+//
+//   void on_insert(const std::string& key, size_t size);
+//   void on_hit(const std::string& key);
+//   void on_erase(const std::string& key);       // removed by the cache
+//   bool peek_victim(std::string& key) const;    // likely next victim
+//   bool evict(std::string& key);                // forgets and returns it
+//   void for_each(fn) const;                     // coldest first
+//
+// Policies only order keys; the shard owns sizes and decides how much to
+// evict. None of them is thread-safe on its own.
+
+using KeyVisitor = std::function<void(const std::string&)>;
+
+class LruPolicy {
+public:
+    void on_insert(const std::string& key, size_t) {
+        keys_.push_front(key);
+        index_[key] = keys_.begin();
+    }
+
+    void on_hit(const std::string& key) {
+        auto it = index_.find(key);
+        if (it != index_.end()) keys_.splice(keys_.begin(), keys_, it->second);
+    }
+
+    void on_erase(const std::string& key);
+    bool peek_victim(std::string& key) const;
+    bool evict(std::string& key);
+    void for_each(const KeyVisitor& fn) const;
+
+private:
+    std::list<std::string> keys_;
+    std::unordered_map<std::string, std::list<std::string>::iterator> index_;
+};
+
+// S3-FIFO (Yang et al., SOSP '23): a small probationary FIFO takes new keys,
+// keys hit more than once there move to the main FIFO, and keys evicted from
+// it are remembered in a ghost FIFO so a quick return goes straight to main.
+// Main is a FIFO with lazy promotion: hit keys get reinserted instead of
+// evicted. Scan-heavy traffic washes through the small queue only.
+class S3FifoPolicy {
+public:
+    void on_insert(const std::string& key, size_t size);
+
+    void on_hit(const std::string& key) {
+        auto it = index_.find(key);
+        if (it == index_.end() || it->second.freq >= 3) return;
+        ++it->second.freq;
+        // A hit in main only moves the pick if it lands on the victim itself
+        if (it->second.in_small || key == victim_) victim_valid_ = false;
+    }
+
+    void on_erase(const std::string& key);
+    bool peek_victim(std::string& key) const;
+    bool evict(std::string& key);
+    void for_each(const KeyVisitor& fn) const;
+
+private:
+    struct Entry {
+        std::list<std::string>::iterator it;
+        size_t size;
+        uint8_t freq;
+        bool in_small;
+    };
+
+    // peek_victim's last answer, until an insert, erase, eviction or a hit
+    // that can change it
+    mutable std::string victim_;
+    mutable bool victim_valid_ = false;
+
+    std::list<std::string> small_;
+    std::list<std::string> main_;
+    std::list<std::string> ghost_;
+    std::unordered_map<std::string, Entry> index_;
+    std::unordered_map<std::string, std::list<std::string>::iterator> ghost_index_;
+    size_t small_bytes_ = 0;
+    size_t total_bytes_ = 0;
+
+    bool evict_from_small() const;
+    void remember_ghost(const std::string& key);
+};
+
+// ARC (Megiddo and Modha, FAST '03): T1 holds keys seen once, T2 keys seen
+// at least twice, and the ghost lists B1/B2 remember what each recently
+// evicted. Ghost hits steer the target size p of T1, so the policy adapts
+// between recency and frequency. Sizes are counted in entries; the shard's
+// byte budget decides how many evictions happen.
+class ArcPolicy {
+public:
+    void on_insert(const std::string& key, size_t size);
+
+    void on_hit(const std::string& key) {
+        auto it = index_.find(key);
+        if (it == index_.end()) return;
+        if (it->second.in_t1) {
+            t2_.splice(t2_.begin(), t1_, it->second.it);
+            it->second.in_t1 = false;
+        } else {
+            t2_.splice(t2_.begin(), t2_, it->second.it);
+        }
+    }
+
+    void on_erase(const std::string& key);
+    bool peek_victim(std::string& key) const;
+    bool evict(std::string& key);
+    void for_each(const KeyVisitor& fn) const;
+
+private:
+    struct Entry {
+        std::list<std::string>::iterator it;
+        bool in_t1;
+    };
+
+    std::list<std::string> t1_, t2_, b1_, b2_;
+    std::unordered_map<std::string, Entry> index_;
+    std::unordered_map<std::string, std::list<std::string>::iterator> b1_index_, b2_index_;
+    double p_ = 0;
+
+    bool evict_from_t1() const;
+    void trim_ghosts();
+};
+
+// GreedyDual-Size-Frequency (Cherkasova, 1998): priority = L + freq * cost /
+// size, where L is the priority of the last victim, so entries age without
+// a sweep. With cost 1 small objects win (object hit ratio); with cost equal
+// to size it degrades to aged LFU (byte hit ratio).
+class GdsfPolicy {
+public:
+    explicit GdsfPolicy(bool byte_hit_ratio) : byte_hit_ratio_(byte_hit_ratio) {}
+
+    void on_insert(const std::string& key, size_t size);
+
+    void on_hit(const std::string& key) {
+        auto it = index_.find(key);
+        if (it == index_.end()) return;
+        ++it->second.freq;
+        reprioritize(it->first, it->second);
+    }
+
+    void on_erase(const std::string& key);
+    bool peek_victim(std::string& key) const;
+    bool evict(std::string& key);
+    void for_each(const KeyVisitor& fn) const;
+
+private:
+    struct Entry {
+        std::multimap<double, std::string>::iterator it;
+        size_t size;
+        uint64_t freq;
+    };
+
+    bool byte_hit_ratio_;
+    double clock_ = 0;
+    std::multimap<double, std::string> by_priority_;
+    std::unordered_map<std::string, Entry> index_;
+
+    void reprioritize(const std::string& key, Entry& entry);
+};
+
+using EvictionPolicy = std::variant<LruPolicy, S3FifoPolicy, ArcPolicy, GdsfPolicy>;
+
+// Known names: lru, s3fifo, arc, gdsf. Throws on anything else.
+EvictionPolicy make_eviction_policy(const std::string& name, bool byte_hit_ratio);
@@ -0,0 +1,59 @@
+#include "evictor.h"
+#include <chrono>
+#include <glog/logging.h>
+#include "constants.h"
+
+Evictor::Evictor(Usage usage, EvictOne evict_one, size_t low_watermark, size_t high_watermark)
+    : usage_(std::move(usage)), evict_one_(std::move(evict_one)), low_watermark_(low_watermark),
+      high_watermark_(high_watermark), thread_(&Evictor::run, this) {}
+
+Evictor::~Evictor() {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stopping_ = true;
+    }
+    cond_.notify_all();
+    thread_.join();
+}
+
+void Evictor::notify() {
+    if (usage_() <= high_watermark_) return;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        woken_ = true;
+    }
+    cond_.notify_one();
+}
+
+void Evictor::run() {
+    while (true) {
+        {
+            // Also checks now and then, in case a crossing went unnoticed
+            std::unique_lock<std::mutex> lock(mutex_);
+            cond_.wait_for(lock, std::chrono::milliseconds(Constants::EvictorPollMs),
+                           [&] { return stopping_ || woken_; });
+            if (stopping_) return;
+            woken_ = false;
+        }
+        size_t before = usage_();
+        if (before <= high_watermark_) continue;
+
+        // Batches let shutdown in between; each eviction takes and drops
+        // its own shard lock, so requests interleave freely
+        size_t evicted = 0;
+        bool exhausted = false;
+        while (!exhausted && usage_() > low_watermark_) {
+            for (size_t i = 0; i < Constants::EvictBatchSize && usage_() > low_watermark_; ++i) {
+                if (!evict_one_()) {
+                    exhausted = true;
+                    break;
+                }
+                ++evicted;
+            }
+            std::lock_guard<std::mutex> lock(mutex_);
+            if (stopping_) return;
+        }
+        LOG(INFO) << "[EVICT] Evicted " << evicted << " entries in the background, " << before << " -> "
+                  << usage_() << " bytes\n";
+    }
+}
@@ -0,0 +1,39 @@
+#pragma once
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+
+// Keeps disk usage below the high watermark without making requests wait:
+// once usage crosses it, a background thread evicts in batches until usage
+// is back at the low watermark. Fills only evict for themselves past the
+// hard ceiling.
+class Evictor {
+public:
+    using Usage = std::function<size_t()>;
+    // Evicts one entry. Returns false if there was nothing to evict.
+    using EvictOne = std::function<bool()>;
+
+    Evictor(Usage usage, EvictOne evict_one, size_t low_watermark, size_t high_watermark);
+    ~Evictor();
+
+    Evictor(const Evictor&) = delete;
+    Evictor& operator=(const Evictor&) = delete;
+
+    // Wakes the thread if usage is past the high watermark
+    void notify();
+
+private:
+    Usage usage_;
+    EvictOne evict_one_;
+    const size_t low_watermark_;
+    const size_t high_watermark_;
+
+    std::mutex mutex_;
+    std::condition_variable cond_;
+    bool woken_ = false;
+    bool stopping_ = false;
+    std::thread thread_;
+
+    void run();
+};
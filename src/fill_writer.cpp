@@ -0,0 +1,155 @@
+#include "fill_writer.h"
+#include <algorithm>
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+#include <stdexcept>
+#include <fcntl.h>
+#include <unistd.h>
+#include "constants.h"
+
+namespace {
+
+bool pwrite_all(int fd, const char* data, size_t len, size_t offset) {
+    while (len > 0) {
+        ssize_t written = ::pwrite(fd, data, len, offset);
+        if (written < 0) {
+            if (errno == EINTR) continue;
+            return false;
+        }
+        data += written;
+        len -= written;
+        offset += written;
+    }
+    return true;
+}
+
+}  // namespace
+
+FillWriter::FillWriter(int fd, const std::string& path, size_t size, bool use_io_uring, size_t direct_min)
+    : fd_(fd), buffer_size_(Constants::StreamBufferSize) {
+    // A fill that fits in one buffer has nothing to overlap
+    if (use_io_uring && size > Constants::FillBufferSize) {
+        // Room for every piece of every buffer to be in flight at once
+        ring_ = IoUring::create(Constants::FillBuffers * (Constants::FillBufferSize / Constants::StreamBufferSize));
+    }
+    if (ring_) buffer_size_ = Constants::FillBufferSize;
+
+    buffers_.resize(ring_ ? Constants::FillBuffers : 1);
+    std::vector<struct iovec> iovecs;
+    for (auto& buffer : buffers_) {
+        // Aligned for O_DIRECT
+        buffer.data.reset(static_cast<char*>(std::aligned_alloc(Constants::DirectIoAlign, buffer_size_)));
+        if (!buffer.data) throw std::bad_alloc();
+        iovecs.push_back(iovec{buffer.data.get(), buffer_size_});
+    }
+    if (!ring_) return;
+
+    registered_ = ring_->register_buffers(iovecs.data(), iovecs.size());
+    if (direct_min > 0 && size >= direct_min) {
+        // Fails on filesystems without O_DIRECT, such as tmpfs
+        direct_fd_ = ::open(path.c_str(), O_WRONLY | O_DIRECT);
+    }
+}
+
+FillWriter::~FillWriter() {
+    // The kernel may still be reading the buffers; wait before freeing them
+    while (ring_) {
+        while (!in_flight_.empty() && in_flight_.front().done) {
+            in_flight_.pop_front();
+            ++first_write_;
+        }
+        if (in_flight_.empty() || !ring_->submit(1)) break;
+        uint64_t id;
+        int result;
+        while (ring_->next_completion(id, result)) in_flight_[id - first_write_].done = true;
+    }
+    if (direct_fd_ >= 0) ::close(direct_fd_);
+}
+
+char* FillWriter::buffer(size_t& len) {
+    if (buffers_[current_].used == buffer_size_) {
+        current_ = (current_ + 1) % buffers_.size();
+        // Still being written from its last turn
+        while (buffers_[current_].writes > 0) reap(true);
+        buffers_[current_].used = 0;
+    }
+    Buffer& buffer = buffers_[current_];
+    len = std::min(buffer_size_ - buffer.used, Constants::StreamBufferSize);
+    return buffer.data.get() + buffer.used;
+}
+
+void FillWriter::commit(size_t len) {
+    if (len > 0) submit(len);
+}
+
+void FillWriter::finish() {
+    while (!in_flight_.empty()) reap(true);
+}
+
+// Writes the len bytes just committed to the current buffer
+void FillWriter::submit(size_t len) {
+    Buffer& buffer = buffers_[current_];
+    const char* data = buffer.data.get() + buffer.used;
+    uint64_t offset = next_offset_;
+    buffer.used += len;
+    next_offset_ += len;
+
+    if (!ring_) {
+        if (!pwrite_all(fd_, data, len, offset)) {
+            throw std::runtime_error(std::string("Failed to write fill: ") + std::strerror(errno));
+        }
+        landed_ = next_offset_;
+        buffer.used = 0;
+        return;
+    }
+
+    // O_DIRECT needs whole blocks; only the last piece can be short
+    bool direct = direct_fd_ >= 0 && offset % Constants::DirectIoAlign == 0 && len % Constants::DirectIoAlign == 0;
+    uint64_t id = first_write_ + in_flight_.size();
+    while (!ring_->queue_write(direct ? direct_fd_ : fd_, data, len, offset,
+                               registered_ ? static_cast<int>(current_) : -1, id)) {
+        reap(true);
+    }
+    in_flight_.push_back(Write{current_, offset, len, false});
+    ++buffer.writes;
+    // A full buffer's pieces go to the kernel in one call; reap and finish
+    // submit whatever a partial one has queued
+    if (buffer.used == buffer_size_ && !ring_->submit(0)) {
+        throw std::runtime_error(std::string("io_uring submit failed: ") + std::strerror(errno));
+    }
+    // Completions are read from the shared ring without a syscall
+    reap(false);
+}
+
+// Collects finished writes, waiting for one first if wait is set, and moves
+// landed_ past every write that is done and has no gap before it
+void FillWriter::reap(bool wait) {
+    if (wait && !ring_->submit(1)) {
+        throw std::runtime_error(std::string("io_uring wait failed: ") + std::strerror(errno));
+    }
+    std::string error;
+    uint64_t id;
+    int result;
+    while (ring_->next_completion(id, result)) {
+        Write& write = in_flight_[id - first_write_];
+        write.done = true;
+        if (result < 0) {
+            error = std::strerror(-result);
+        } else if (static_cast<size_t>(result) != write.len) {
+            error = "short write";
+        }
+    }
+    if (!error.empty()) {
+        throw std::runtime_error("Failed to write fill: " + error);
+    }
+
+    while (!in_flight_.empty() && in_flight_.front().done) {
+        const Write& write = in_flight_.front();
+        landed_ = write.offset + write.len;
+        --buffers_[write.buffer].writes;
+        in_flight_.pop_front();
+        ++first_write_;
+    }
+}
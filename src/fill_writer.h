@@ -0,0 +1,74 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <deque>
+#include <memory>
+#include <string>
+#include <vector>
+#include "io_uring.h"
+
+// Writes a fill's bytes to its .tmp file in order. With io_uring, upstream
+// data is read straight into registered buffers whose writes run while the
+// next bytes are read, and a fill of at least direct_min bytes also bypasses
+// the page cache with O_DIRECT, so one-off large objects do not push hot
+// ones out of it. Without io_uring, each piece is written with pwrite()
+// before the next is read. Either way bytes are handed out and written in
+// pieces of at most StreamBufferSize, so readers following the fill see it
+// grow in steps of that size, not of whole buffers. With io_uring a
+// buffer's pieces are submitted together once it is full, so a fill costs
+// one io_uring_enter per buffer.
+class FillWriter {
+public:
+    // fd is the .tmp file at path, open for writing at offset 0
+    FillWriter(int fd, const std::string& path, size_t size, bool use_io_uring, size_t direct_min);
+    ~FillWriter();
+
+    FillWriter(const FillWriter&) = delete;
+    FillWriter& operator=(const FillWriter&) = delete;
+
+    // Space for the next bytes, at most StreamBufferSize; may wait for an
+    // earlier write to free it
+    char* buffer(size_t& len);
+    // Writes, or queues for writing, the first len bytes of the last
+    // buffer(). Throws if a write failed.
+    void commit(size_t len);
+    // Waits for every write. Throws if one failed.
+    void finish();
+
+    // Bytes from the start of the file that are written and readable
+    // through other descriptors
+    size_t landed() const { return landed_; }
+
+private:
+    struct Free {
+        void operator()(char* data) const { std::free(data); }
+    };
+    struct Buffer {
+        std::unique_ptr<char, Free> data;
+        size_t used = 0;
+        size_t writes = 0;      // in flight from this buffer
+    };
+    // One queued write; user_data is its sequence number
+    struct Write {
+        size_t buffer;
+        uint64_t offset;
+        size_t len;
+        bool done;
+    };
+
+    int fd_;
+    int direct_fd_ = -1;
+    size_t buffer_size_;
+    std::unique_ptr<IoUring> ring_;
+    bool registered_ = false;
+    std::vector<Buffer> buffers_;
+    size_t current_ = 0;
+    uint64_t next_offset_ = 0;
+    std::deque<Write> in_flight_;   // in file order
+    uint64_t first_write_ = 0;      // sequence number of in_flight_.front()
+    size_t landed_ = 0;
+
+    void submit(size_t len);
+    void reap(bool wait);
+};
@@ -0,0 +1,84 @@
+#include "frequency_sketch.h"
+#include <algorithm>
+#include <functional>
+
+namespace {
+
+size_t next_power_of_two(size_t n) {
+    size_t power = 1;
+    while (power < n) power <<= 1;
+    return power;
+}
+
+}  // namespace
+
+FrequencySketch::FrequencySketch(size_t expected_entries)
+    : additions_(0) {
+    // 16 counters per word, two counters per expected entry
+    size_t words = next_power_of_two(std::max<size_t>(expected_entries / 8, 64));
+    table_ = std::make_unique<std::atomic<uint64_t>[]>(words);
+    for (size_t i = 0; i < words; ++i) table_[i] = 0;
+    table_mask_ = words * 16 - 1;
+    sample_size_ = std::max<size_t>(expected_entries, 64) * 10;
+}
+
+void FrequencySketch::increment(const std::string& key) {
+    uint64_t h = hash(key);
+    bool added = false;
+    for (int row = 0; row < Depth; ++row) {
+        added |= increment_at(counter_index(h, row));
+    }
+    if (added && ++additions_ == sample_size_) {
+        age();
+    }
+}
+
+uint32_t FrequencySketch::frequency(const std::string& key) const {
+    uint64_t h = hash(key);
+    uint32_t frequency = 15;
+    for (int row = 0; row < Depth; ++row) {
+        size_t counter = counter_index(h, row);
+        uint64_t word = table_[counter >> 4].load(std::memory_order_relaxed);
+        frequency = std::min<uint32_t>(frequency, (word >> ((counter & 15) << 2)) & 0xf);
+    }
+    return frequency;
+}
+
+uint64_t FrequencySketch::hash(const std::string& key) {
+    // splitmix64 finalizer over std::hash, which may be the identity-ish
+    uint64_t h = std::hash<std::string>{}(key);
+    h = (h ^ (h >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    h = (h ^ (h >> 27)) * 0x94d049bb133111ebULL;
+    return h ^ (h >> 31);
+}
+
+size_t FrequencySketch::counter_index(uint64_t hash, int row) const {
+    // Double hashing: row i probes h1 + i * h2
+    uint64_t h1 = hash & 0xffffffff;
+    uint64_t h2 = (hash >> 32) | 1;
+    return (h1 + row * h2) & table_mask_;
+}
+
+bool FrequencySketch::increment_at(size_t counter) {
+    auto& word = table_[counter >> 4];
+    int shift = (counter & 15) << 2;
+    uint64_t current = word.load(std::memory_order_relaxed);
+    while (((current >> shift) & 0xf) < 15) {
+        if (word.compare_exchange_weak(current, current + (uint64_t(1) << shift), std::memory_order_relaxed)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+// Halves every counter. Whoever crosses the sample size does the sweep.
+void FrequencySketch::age() {
+    additions_ = 0;
+    size_t words = (table_mask_ + 1) / 16;
+    for (size_t i = 0; i < words; ++i) {
+        uint64_t current = table_[i].load(std::memory_order_relaxed);
+        while (!table_[i].compare_exchange_weak(current, (current >> 1) & 0x7777777777777777ULL,
+                                                std::memory_order_relaxed)) {
+        }
+    }
+}
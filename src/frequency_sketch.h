@@ -0,0 +1,31 @@
+#pragma once
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <string>
+
+// Count-min sketch of 4-bit counters for estimating how often a key was
+// requested recently. Counters are halved every sample_size increments, so
+// old popularity fades. Safe to use from many threads without a lock;
+// concurrent updates may occasionally be lost, which only blurs estimates.
+class FrequencySketch {
+public:
+    // expected_entries sizes the table; about 8 bits of counters per entry.
+    explicit FrequencySketch(size_t expected_entries);
+
+    void increment(const std::string& key);
+    uint32_t frequency(const std::string& key) const;
+
+private:
+    static constexpr int Depth = 4;
+
+    std::unique_ptr<std::atomic<uint64_t>[]> table_;
+    size_t table_mask_;
+    size_t sample_size_;
+    std::atomic<size_t> additions_;
+
+    static uint64_t hash(const std::string& key);
+    size_t counter_index(uint64_t hash, int row) const;
+    bool increment_at(size_t counter);
+    void age();
+};
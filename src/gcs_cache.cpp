@@ -1,89 +1,1574 @@
 #include "gcs_cache.h"
 #include <filesystem>
-#include <fstream>
+#include <algorithm>
+#include <cerrno>
+#include <cmath>
+#include <cstdlib>
+#include <thread>
+#include <unordered_set>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "constants.h"
+#include "crc32c.h"
+#include "readahead.h"
+#include "warmup_jobs.h"
+#include "manifest_prefetcher.h"
+#include "scrubber.h"
+#include "deletion_queue.h"
+#include "evictor.h"
+#include "fill_writer.h"
+#include "io_uring.h"
+#include "zstd_seekable.h"
 
 namespace gcs = google::cloud::storage;
 
+static bool pwrite_all(int fd, const char* data, size_t len, size_t offset) {
+    while (len > 0) {
+        ssize_t written = ::pwrite(fd, data, len, offset);
+        if (written < 0) {
+            if (errno == EINTR) continue;
+            return false;
+        }
+        data += written;
+        len -= written;
+        offset += written;
+    }
+    return true;
+}
+
+static bool crc32c_of_file(int fd, size_t size, uint32_t& crc32c) {
+    Crc32c crc;
+    char buffer[Constants::StreamBufferSize];
+    for (size_t offset = 0; offset < size;) {
+        ssize_t bytes_read = ::pread(fd, buffer, std::min(sizeof(buffer), size - offset), offset);
+        if (bytes_read < 0 && errno == EINTR) continue;
+        if (bytes_read <= 0) return false;
+        crc.update(buffer, bytes_read);
+        offset += bytes_read;
+    }
+    crc32c = crc.value();
+    return true;
+}
+
+// An object's cache key, which is also its path under cache_dir. Reads pinned
+// to a generation get their own key, so they never replace the live copy.
+static std::string object_key(const std::string& bucket, const std::string& file, int64_t generation) {
+    return bucket + "/" + file + (generation ? "#" + std::to_string(generation) : "");
+}
+
+// Prefix of the keys of an object's blocks. The block size is part of it, so
+// blocks cut at another size are never read back as these.
+static std::string blocks_key(const std::string& object_key, size_t block_size) {
+    return object_key + ".blk" + std::to_string(block_size) + "/";
+}
+
+// Whether key is a block cut at another size than block_size, including one
+// from before sizes were in block keys (.blk/<n>)
+static bool stale_block_key(const std::string& key, size_t block_size) {
+    size_t slash = key.rfind('/');
+    size_t blk = slash == std::string::npos ? std::string::npos : key.rfind(".blk", slash);
+    if (blk == std::string::npos) return false;
+    std::string size = key.substr(blk + 4, slash - blk - 4);
+    if (!std::all_of(size.begin(), size.end(), [](char c) { return c >= '0' && c <= '9'; })) return false;
+    return size != std::to_string(block_size);
+}
+
+// What a file takes on disk, which for a compressed one is less than the
+// object's size; fallback if it cannot be stat'ed
+static size_t disk_bytes_of(const std::string& path, size_t fallback) {
+    struct stat st;
+    return ::stat(path.c_str(), &st) == 0 ? st.st_size : fallback;
+}
+
 GCSCache::GCSCache(const Config& config)
-    : config_(config), current_cache_size_(0), ram_tracker_(config.max_ram_usage),
+    : config_(config), current_cache_size_(0),
+    ram_tracker_(config.max_ram_usage, RamTracker::TenantBudget{config.client_ram_max, config.client_ram_min,
+                                                                config.bucket_ram_max, config.bucket_ram_min}),
+    ram_tier_(ram_tracker_, config.ram_tier_size),
+    buffer_pool_(ram_tracker_, config.max_ram_usage, config.huge_pages),
     storage_client_(gcs::Client(
         gcs::ClientOptions::CreateDefaultClientOptions().value()
             .set_endpoint(config.gcs_endpoint)
-            .set_credentials(gcs::oauth2::CreateAnonymousCredentials()))) {
-    std::filesystem::create_directories(config.cache_dir);
+            .set_credentials(gcs::oauth2::CreateAnonymousCredentials()))),
+    sketch_(config.max_disk_cache_size / Constants::SketchAverageObjectSize),
+    window_capacity_(config.max_disk_cache_size / 100 * config.admission_window_pct),
+    hits_(0), ram_hits_(0), misses_(0), bypassed_(0), prefetched_(0), corrupt_(0), revalidated_(0), stale_(0),
+    negative_hits_(0), negative_(Constants::NegativeCacheEntries, config.negative_ttl_sec),
+    journal_(config.cache_dir),
+    compacting_(false),
+    metadata_(Constants::MetadataCacheEntries),
+    chunk_store_(config.cache_dir),
+    chunker_(Constants::CdcMinChunk, Constants::CdcAvgChunk, Constants::CdcMaxChunk) {
+    for (size_t i = 0; i < config.cache_shards; ++i) {
+        shards_.push_back(std::make_unique<CacheShard>(config.eviction_policy, config.eviction_byte_hit_ratio));
+    }
+    if (config_.io_uring) {
+        auto ring = IoUring::create(1);
+        if (!ring || !ring->supports_writes()) {
+            LOG(INFO) << "[CACHE] io_uring is not available, writing fills with pwrite\n";
+            config_.io_uring = false;
+        }
+    }
+    bool compression = config_.compression;
+    for (const auto& [bucket, on] : config_.bucket_compression) compression = compression || on;
+    if (compression && !SeekableZstd::available()) {
+        LOG(WARNING) << "[CACHE] Built without zstd, caching objects uncompressed\n";
+        config_.compression = false;
+        config_.bucket_compression.clear();
+    }
+    std::filesystem::create_directories(config.cache_dir + "/.trash");
+    deletions_ = std::make_unique<DeletionQueue>();
+    load_index();
+    if (config.block_size > 0 && config.readahead_blocks > 0) {
+        readahead_ = std::make_unique<Readahead>([this](const CacheUnit& unit) {
+            size_t bytes;
+            return prefetch(unit, bytes);
+        }, config.readahead_blocks, config.readahead_budget);
+    }
+    warmup_jobs_ = std::make_unique<WarmupJobs>(*this, config.warmup_concurrency, config.max_disk_cache_size);
+    manifests_ = std::make_unique<ManifestPrefetcher>(
+        [this](const std::string& bucket, const std::string& file) { warm_object(file, bucket); },
+        [this](const std::string& bucket, const std::string& file) { mark_consumed(bucket, file); },
+        config.manifest_window);
+    if (config.scrub_rate > 0) {
+        scrubber_ = std::make_unique<Scrubber>([this] { return scrub_candidates(); },
+                                               [this](const std::string& key) { return scrub_entry(key); },
+                                               config.scrub_rate);
+    }
+    evictor_ = std::make_unique<Evictor>([this] { return current_cache_size_.load(); },
+                                         [this] { return evict_step(); },
+                                         config.evict_low_watermark, config.evict_high_watermark);
 }
 
-std::shared_ptr<Client> GCSCache::get_client(const QosConfig& qos) {
-    return std::make_shared<Client>(this, qos);
+GCSCache::~GCSCache() = default;
+
+void GCSCache::load_index() {
+    auto records = journal_.load();
+    for (const auto& record : records) {
+        // reconcile_cache_dir removes its file
+        if (stale_block_key(record.key, config_.block_size)) continue;
+        size_t disk_bytes = record.disk_size;
+        if (config_.dedup) {
+            // Chunks are only known through the recipes that use them
+            std::string path = config_.cache_dir + "/" + record.key;
+            int fd = ::open(path.c_str(), O_RDONLY);
+            Recipe recipe;
+            bool loaded = fd >= 0 && ChunkStore::read_recipe(fd, recipe) && chunk_store_.add_refs(recipe, disk_bytes);
+            if (fd >= 0) ::close(fd);
+            if (!loaded) {
+                LOG(WARNING) << "[CACHE] Dropping " << record.key << ": recipe or chunks missing\n";
+                ::unlink(path.c_str());
+                journal_.record_remove(record.key);
+                continue;
+            }
+            disk_bytes += ChunkStore::recipe_bytes(recipe);
+        }
+        shard_for(record.key).insert(record.key, record.size, record.disk_size, record.generation, false,
+                                     record.crc32c);
+        current_cache_size_ += disk_bytes;
+    }
+    LOG(INFO) << "[CACHE] Restored " << records.size() << " entries (" << current_cache_size_ << " bytes)\n";
+
+    // cache_dir may disagree with the index after a crash; fix that up
+    // without holding back startup
+    std::thread(&GCSCache::reconcile_cache_dir, this, std::move(records)).detach();
 }
 
-std::string GCSCache::get_or_fetch_object(const std::string& file, const std::string& bucket) {
-    std::lock_guard<std::mutex> lock(cache_mutex_);
+// Removes stale .tmp files, adopts completed files the journal never
+// recorded, and drops entries whose file is gone.
+void GCSCache::reconcile_cache_dir(std::vector<IndexRecord> loaded) {
+    namespace fs = std::filesystem;
+    const std::string tmp_suffix = ".tmp";
+    std::unordered_set<std::string> on_disk;
+    std::vector<std::string> chunk_files;
+    size_t removed_tmp = 0, adopted = 0, dropped = 0, orphan_chunks = 0, stale_blocks = 0;
+
+    std::error_code ec;
+    for (fs::recursive_directory_iterator it(config_.cache_dir, ec), end; !ec && it != end; it.increment(ec)) {
+        if (!it->is_regular_file()) continue;
+        std::string key = fs::relative(it->path(), config_.cache_dir).generic_string();
+        if (key.find('/') == std::string::npos) continue; // index files, not objects
+        if (key.compare(0, 7, ".trash/") == 0) {
+            // Evictions a restart cut short
+            deletions_->push(it->path().string());
+            continue;
+        }
+        if (key.compare(0, 8, ".chunks/") == 0) {
+            // Checked once every recipe on disk holds its references
+            chunk_files.push_back(it->path().filename().string());
+            continue;
+        }
 
-    // Build path: <cache_dir>/<bucket>/<file>
-    std::string bucket_dir = config_.cache_dir + "/" + bucket;
-    std::string local_path = bucket_dir + "/" + file;
-    std::string cache_key = bucket + "/" + file;
+        bool is_tmp = key.size() > tmp_suffix.size() &&
+                      key.compare(key.size() - tmp_suffix.size(), tmp_suffix.size(), tmp_suffix) == 0;
+        if (is_tmp) key.resize(key.size() - tmp_suffix.size());
+
+        // <key>.zst.tmp is compress_fill's output while <key>'s fill publishes
+        const std::string zst_suffix = ".zst";
+        if (is_tmp && key.size() > zst_suffix.size() &&
+            key.compare(key.size() - zst_suffix.size(), zst_suffix.size(), zst_suffix) == 0) {
+            std::string owner = key.substr(0, key.size() - zst_suffix.size());
+            CacheShard& owner_shard = shard_for(owner);
+            std::lock_guard<std::mutex> lock(owner_shard.mutex);
+            if (owner_shard.in_flight.count(owner)) continue;
+        }
+
+        if (!is_tmp && stale_block_key(key, config_.block_size)) {
+            // Cut at a block_size since changed; load_index left it out
+            std::error_code remove_ec;
+            fs::remove(it->path(), remove_ec);
+            ++stale_blocks;
+            continue;
+        }
+
+        CacheShard& shard = shard_for(key);
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        // Anything in flight belongs to a fill started since this boot
+        if (shard.in_flight.count(key)) continue;
+        if (is_tmp) {
+            std::error_code remove_ec;
+            fs::remove(it->path(), remove_ec);
+            ++removed_tmp;
+            continue;
+        }
+
+        on_disk.insert(key);
+        if (!shard.contains(key)) {
+            size_t file_bytes = it->file_size();
+            size_t size = file_bytes;
+            size_t disk_bytes = file_bytes;
+            if (config_.dedup) {
+                int fd = ::open(it->path().c_str(), O_RDONLY);
+                Recipe recipe;
+                bool loaded = fd >= 0 && ChunkStore::read_recipe(fd, recipe) &&
+                              chunk_store_.add_refs(recipe, disk_bytes);
+                if (fd >= 0) ::close(fd);
+                if (!loaded) {
+                    std::error_code remove_ec;
+                    fs::remove(it->path(), remove_ec);
+                    continue;
+                }
+                disk_bytes += size;
+                size = recipe.size;
+            } else {
+                int fd = ::open(it->path().c_str(), O_RDONLY);
+                std::vector<SeekableZstd::Frame> frames;
+                if (fd >= 0 && SeekableZstd::read_frames(fd, size, frames)) {
+                    size = 0;
+                    for (const auto& frame : frames) size += frame.size;
+                }
+                if (fd >= 0) ::close(fd);
+            }
+            shard.insert(key, size, file_bytes, 0);
+            journal_.record_add(IndexRecord{key, size, file_bytes, 0, std::nullopt});
+            current_cache_size_ += disk_bytes;
+            ++adopted;
+        }
+    }
+
+    for (const auto& name : chunk_files) {
+        if (chunk_store_.remove_orphan(name)) ++orphan_chunks;
+    }
 
+    for (const auto& record : loaded) {
+        if (on_disk.count(record.key)) continue;
+        CacheShard& shard = shard_for(record.key);
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        if (fs::exists(config_.cache_dir + "/" + record.key)) continue;
+        size_t size = shard.erase(record.key);
+        if (size == 0) continue;
+        journal_.record_remove(record.key);
+        current_cache_size_ -= size;
+        ++dropped;
+    }
+
+    LOG(INFO) << "[CACHE] Reconciled cache_dir: removed " << removed_tmp << " stale .tmp files, adopted "
+              << adopted << " files, dropped " << dropped << " missing entries, " << stale_blocks
+              << " blocks of another block_size and " << orphan_chunks << " unreferenced chunks\n";
+    evict_if_needed(0);
+    compact_index();
+}
+
+// Snapshots the index and truncates the journal. Only one compaction runs at
+// a time; a caller that finds one running skips it.
+void GCSCache::compact_index() {
+    if (compacting_.exchange(true)) return;
+
+    journal_.rotate();
+    std::vector<IndexRecord> records;
+    for (auto& shard : shards_) {
+        std::lock_guard<std::mutex> lock(shard->mutex);
+        shard->for_each_lru([&](const std::string& key, const CacheEntry& entry) {
+            records.push_back(IndexRecord{key, entry.size, entry.disk_size, entry.generation, entry.crc32c});
+        });
+    }
+    journal_.write_snapshot(records);
+    compacting_ = false;
+}
+
+std::shared_ptr<Client> GCSCache::get_client(const std::string& client_id, const QosConfig& qos) {
+    return std::make_shared<Client>(this, client_id, qos);
+}
+
+std::shared_ptr<ObjectReader> GCSCache::get_or_fetch_object(const std::string& file, const std::string& bucket,
+                                                            const std::string& client_id, int64_t generation,
+                                                            bool accept_zstd) {
     LOG(INFO) << "[CACHE] Fetching Object: " << file << " form bucket: " << bucket << "\n";
+    check_negative(bucket, file, generation);
+    manifests_->on_object_read(client_id, bucket, file);
+
+    if (config_.block_size > 0) {
+        return get_or_fetch_blocks(file, bucket, client_id, generation);
+    }
+    return get_or_fetch(CacheUnit{bucket, file, object_key(bucket, file, generation), 0, -1, generation, accept_zstd});
+}
+
+// Block mode: the object is served as a sequence of independently cached
+// blocks, stored at <cache_dir>/<object key>.blk<block_size>/<index>. Every
+// block is read at the generation live when the request starts, so a request
+// never mixes blocks of two generations; cached blocks of another one are
+// misses.
+std::shared_ptr<ObjectReader> GCSCache::get_or_fetch_blocks(const std::string& file, const std::string& bucket,
+                                                            const std::string& client_id, int64_t generation) {
+    ObjectMetadata metadata = object_metadata(bucket, file, generation);
+    uint64_t size = metadata.size;
+    size_t block_size = config_.block_size;
+    std::string key = blocks_key(object_key(bucket, file, generation), block_size);
+    if (!generation) generation = metadata.generation;
+    size_t block_count = (size + block_size - 1) / block_size;
+
+    return std::make_shared<ObjectReader>([this, file, bucket, client_id, key, generation, size, block_size,
+                                           block_count](size_t index) {
+        int64_t begin = index * block_size;
+        int64_t end = std::min<uint64_t>(begin + block_size, size);
+        auto reader = get_or_fetch(CacheUnit{bucket, file, key + std::to_string(index), begin, end, generation});
+        if (readahead_) {
+            readahead_->on_block_read(client_id, bucket, file, key, generation, index, block_count, block_size,
+                                      size);
+        }
+        return reader;
+    }, size, block_size);
+}
+
+// Fills a unit for read-ahead or warm-up without counting it as a client
+// access, and returns once the fill is done with bytes set to what it
+// fetched. Returns false if it was already cached or being filled, or if
+// admission turned it away.
+bool GCSCache::prefetch(const CacheUnit& unit, size_t& bytes) {
+    bytes = 0;
+    CacheShard& shard = shard_for(unit.key);
+    auto fill = std::make_shared<InFlightFill>();
+    {
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        const CacheEntry* entry = shard.find(unit.key);
+        // Another generation than the one asked for is refilled, as in get_or_fetch
+        bool cached = entry && (!unit.generation || entry->generation == unit.generation);
+        if (cached || shard.in_flight.count(unit.key)) return false;
+        shard.in_flight.emplace(unit.key, fill);
+    }
+
+    LOG(INFO) << "[CACHE] PREFETCH: " << unit.key << "\n";
+    ++prefetched_;
+    lead_fill(unit, fill);
+    std::unique_lock<std::mutex> lock(fill->mutex);
+    fill->cond.wait(lock, [&] { return fill->done; });
+    if (!fill->error.empty()) {
+        if (fill->not_found) throw ObjectNotFound(fill->error);
+        throw std::runtime_error(fill->error);
+    }
+    // A bypassed fill finishes without ever starting
+    if (!fill->started) return false;
+    bytes = fill->bytes_written;
+    return true;
+}
+
+uint64_t GCSCache::warm_object(const std::string& file, const std::string& bucket) {
+    // A warm-up is a hint the object exists now
+    negative_.erase(bucket + "/" + file);
+    size_t bytes = 0;
+    if (config_.block_size == 0) {
+        CacheUnit unit{bucket, file, bucket + "/" + file};
+        unit.skip_admission = true;
+        prefetch(unit, bytes);
+        return bytes;
+    }
+
+    // Pinned to one generation, as a client read of the blocks would be
+    ObjectMetadata metadata = object_metadata(bucket, file);
+    uint64_t size = metadata.size;
+    std::string blocks = blocks_key(bucket + "/" + file, config_.block_size);
+    uint64_t total = 0;
+    for (uint64_t begin = 0; begin < size; begin += config_.block_size) {
+        uint64_t end = std::min<uint64_t>(begin + config_.block_size, size);
+        std::string key = blocks + std::to_string(begin / config_.block_size);
+        CacheUnit unit{bucket, file, key, static_cast<int64_t>(begin), static_cast<int64_t>(end), metadata.generation};
+        unit.skip_admission = true;
+        prefetch(unit, bytes);
+        total += bytes;
+    }
+    return total;
+}
+
+void GCSCache::list_objects(const std::string& bucket, const std::string& prefix,
+                            const std::function<bool(const std::string&, uint64_t)>& fn) {
+    for (auto& metadata : storage_client_.ListObjects(bucket, gcs::Prefix(prefix))) {
+        if (!metadata) {
+            throw std::runtime_error(metadata.status().message());
+        }
+        remember_metadata(bucket, metadata->name(), 0, *metadata);
+        if (!fn(metadata->name(), metadata->size())) return;
+    }
+}
 
-    if (is_cached(cache_key)) {
-        LOG(INFO) << "[CACHE] HIT: " << cache_key << "\n";
-        lru_keys_.erase(cache_index_[cache_key]);
-        lru_keys_.push_front(cache_key);
-        cache_index_[cache_key] = lru_keys_.begin();
-        return local_path;
+WarmupJobs& GCSCache::warmup_jobs() {
+    return *warmup_jobs_;
+}
+
+ManifestPrefetcher& GCSCache::manifests() {
+    return *manifests_;
+}
+
+size_t GCSCache::purge_negative(const std::string& bucket, const std::string& file) {
+    if (bucket.empty()) return negative_.erase_prefix("");
+    if (file.empty()) return negative_.erase_prefix(bucket + "/");
+    return negative_.erase(bucket + "/" + file);
+}
+
+// Answers a read of the live object with a 404 if GCS recently had none
+void GCSCache::check_negative(const std::string& bucket, const std::string& file, int64_t generation) {
+    if (generation || !negative_.contains(bucket + "/" + file)) return;
+    LOG(INFO) << "[CACHE] NEGATIVE HIT: " << bucket << "/" << file << "\n";
+    ++negative_hits_;
+    throw ObjectNotFound("No such object: " + bucket + "/" + file);
+}
+
+void GCSCache::not_found(const std::string& bucket, const std::string& file, int64_t generation,
+                         const std::string& message) {
+    LOG(INFO) << "[CACHE] NOT FOUND: " << bucket << "/" << file
+              << (generation ? " generation " + std::to_string(generation) : "") << "\n";
+    if (!generation) {
+        negative_.insert(bucket + "/" + file);
+        metadata_.erase(bucket + "/" + file);
+    }
+    throw ObjectNotFound(message);
+}
+
+void GCSCache::mark_consumed(const std::string& bucket, const std::string& file) {
+    std::vector<std::string> keys;
+    if (config_.block_size == 0) {
+        keys.push_back(bucket + "/" + file);
+    } else {
+        uint64_t size = object_metadata(bucket, file).size;
+        for (uint64_t index = 0; index * config_.block_size < size; ++index) {
+            keys.push_back(blocks_key(bucket + "/" + file, config_.block_size) + std::to_string(index));
+        }
+    }
+
+    std::lock_guard<std::mutex> lock(consumed_mutex_);
+    for (auto& key : keys) consumed_keys_.push_back(std::move(key));
+    while (consumed_keys_.size() > Constants::ConsumedKeysKept) consumed_keys_.pop_front();
+}
+
+// Opens an object for Range requests without starting a fill for it: a
+// cached or in-flight copy is read locally, anything else with ranged
+// upstream reads of just the requested bytes. Block mode fetches and caches
+// only the blocks the ranges touch.
+std::shared_ptr<ObjectReader> GCSCache::get_object_for_range(const std::string& file, const std::string& bucket,
+                                                             const std::string& client_id, int64_t generation) {
+    check_negative(bucket, file, generation);
+    manifests_->on_object_read(client_id, bucket, file);
+    if (config_.block_size > 0) {
+        return get_or_fetch_blocks(file, bucket, client_id, generation);
+    }
+
+    CacheUnit unit{bucket, file, object_key(bucket, file, generation), 0, -1, generation};
+    const std::string& cache_key = unit.key;
+    CacheShard& shard = shard_for(cache_key);
+    bool check_first;
+    {
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        const CacheEntry* entry = shard.find(cache_key);
+        check_first = entry && !fresh(unit, *entry);
+    }
+    // A copy that needs checking with GCS, or of another generation, goes
+    // through the fill path, which does that
+    if (check_first) return get_or_fetch(unit);
+
+    if (config_.admission_enabled) sketch_.increment(cache_key);
+    int64_t ram_generation = 0;
+    if (auto data = ram_tier_.get(cache_key, ram_generation)) {
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        const CacheEntry* entry = shard.find(cache_key);
+        if (ram_current(unit, entry, ram_generation)) {
+            LOG(INFO) << "[CACHE] RAM HIT: " << cache_key << "\n";
+            ++ram_hits_;
+            if (entry) shard.touch(cache_key);
+            return std::make_shared<ObjectReader>(data);
+        }
+    }
+
+    std::shared_ptr<InFlightFill> fill;
+    {
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        if (auto reader = open_cached(shard, cache_key)) {
+            LOG(INFO) << "[CACHE] HIT: " << cache_key << "\n";
+            ++hits_;
+            shard.touch(cache_key);
+            return reader;
+        }
+        auto it = shard.in_flight.find(cache_key);
+        if (it != shard.in_flight.end()) fill = it->second;
+    }
+
+    if (fill) {
+        auto reader = join_fill(cache_key, fill);
+        if (reader) return reader;
+        return get_object_for_range(file, bucket, client_id, generation);
+    }
+
+    LOG(INFO) << "[CACHE] MISS: " << cache_key << ", serving ranges from remote store\n";
+    ++misses_;
+    uint64_t size = object_metadata(bucket, file, generation).size;
+    return std::make_shared<ObjectReader>([this, file, bucket, generation](size_t begin, size_t end) {
+        auto reader = std::make_shared<gcs::ObjectReadStream>(storage_client_.ReadObject(
+            bucket, file, gcs::ReadRange(begin, end), generation ? gcs::Generation(generation) : gcs::Generation()));
+        if (!*reader) {
+            if (reader->status().code() == google::cloud::StatusCode::kNotFound) {
+                not_found(bucket, file, generation, reader->status().message());
+            }
+            throw std::runtime_error(reader->status().message());
+        }
+        return reader;
+    }, size);
+}
+
+ObjectMetadata GCSCache::object_metadata(const std::string& bucket, const std::string& file, int64_t generation) {
+    check_negative(bucket, file, generation);
+    std::string key = bucket + "/" + file + (generation ? "#" + std::to_string(generation) : "");
+    if (auto cached = metadata_.get(key)) return *cached;
+
+    auto metadata = storage_client_.GetObjectMetadata(bucket, file,
+                                                      generation ? gcs::Generation(generation) : gcs::Generation());
+    if (!metadata) {
+        if (metadata.status().code() == google::cloud::StatusCode::kNotFound) {
+            not_found(bucket, file, generation, metadata.status().message());
+        }
+        LOG(ERROR) << "GetObjectMetadata error: " << file << " is not in bucket " << bucket << "\n";
+        throw std::runtime_error(metadata.status().message());
+    }
+    return remember_metadata(bucket, file, generation, *metadata);
+}
+
+ObjectMetadata GCSCache::remember_metadata(const std::string& bucket, const std::string& file, int64_t generation,
+                                           const gcs::ObjectMetadata& gcs_metadata) {
+    ObjectMetadata metadata{gcs_metadata.size(), gcs_metadata.generation(), gcs_metadata.metageneration(),
+                            Crc32c::from_hash_header("crc32c=" + gcs_metadata.crc32c()),
+                            gcs_metadata.content_type(), gcs_metadata.updated()};
+    // A named generation cannot change
+    auto fresh_until = std::chrono::steady_clock::time_point::max();
+    if (!generation) {
+        const ConsistencyConfig& consistency = consistency_for(bucket);
+        if (consistency.mode == "strong") return metadata;
+        if (consistency.mode == "ttl") {
+            fresh_until = std::chrono::steady_clock::now() + std::chrono::seconds(consistency.ttl_sec);
+        }
+    }
+    metadata_.put(bucket + "/" + file + (generation ? "#" + std::to_string(generation) : ""), metadata, fresh_until);
+    return metadata;
+}
+
+std::shared_ptr<ObjectReader> GCSCache::get_or_fetch(const CacheUnit& unit, bool validated) {
+    const std::string& cache_key = unit.key;
+
+    if (config_.admission_enabled && !validated) sketch_.increment(cache_key);
+
+    CacheShard& shard = shard_for(cache_key);
+    int64_t ram_generation = 0;
+    if (auto data = ram_tier_.get(cache_key, ram_generation)) {
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        const CacheEntry* entry = shard.find(cache_key);
+        if (ram_current(unit, entry, ram_generation) && (!entry || validated || fresh(unit, *entry))) {
+            LOG(INFO) << "[CACHE] RAM HIT: " << cache_key << "\n";
+            ++ram_hits_;
+            if (entry) shard.touch(cache_key);
+            return std::make_shared<ObjectReader>(data);
+        }
+    }
+
+    std::shared_ptr<InFlightFill> fill;
+    bool leader = false;
+    std::shared_ptr<ObjectReader> cached;
+    size_t size = 0;
+    int64_t generation = 0;
+    bool revalidate_first = false;
+    int64_t cached_generation = 0;
+    {
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        const CacheEntry* entry = shard.find(cache_key);
+        // A different generation than the one asked for is a miss; the fill
+        // replaces it
+        bool usable = entry && (!unit.generation || entry->generation == unit.generation);
+        if (usable && !validated && !fresh(unit, *entry)) {
+            revalidate_first = true;
+            cached_generation = entry->generation;
+        } else if (usable) {
+            cached = open_cached(shard, cache_key, unit.accept_zstd);
+        }
+        if (revalidate_first) {
+            // Checked with GCS below, outside the lock
+        } else if (cached) {
+            LOG(INFO) << "[CACHE] HIT: " << cache_key << "\n";
+            ++hits_;
+            const CacheEntry& entry = shard.touch(cache_key);
+            // The RAM tier holds objects decompressed
+            if (entry.hits < Constants::RamPromoteHits || entry.size > config_.ram_object_max ||
+                !cached->content_encoding().empty()) {
+                return cached;
+            }
+            size = entry.size;
+            generation = entry.generation;
+        } else {
+            auto it = shard.in_flight.find(cache_key);
+            if (it != shard.in_flight.end()) {
+                fill = it->second;
+            } else {
+                fill = std::make_shared<InFlightFill>();
+                shard.in_flight.emplace(cache_key, fill);
+                leader = true;
+            }
+        }
+    }
+
+    if (revalidate_first) {
+        return revalidate(unit, cached_generation);
+    }
+
+    if (cached) {
+        return promote_to_ram(shard, cache_key, std::move(cached), size, generation);
+    }
+
+    if (!leader) {
+        auto reader = join_fill(cache_key, fill);
+        if (reader) return reader;
+        // The fill was published while we waited, so this is a hit now
+        return get_or_fetch(unit, true);
     }
 
     LOG(INFO) << "[CACHE] MISS: " << cache_key << ", reading from remote store\n";
-    auto reader = storage_client_.ReadObject(bucket, file);
+    ++misses_;
+    return lead_fill(unit, fill);
+}
+
+// Whether a RAM copy of generation is of the one asked for and of the entry
+// on disk, which a refill may have replaced since the copy was made.
+bool GCSCache::ram_current(const CacheUnit& unit, const CacheEntry* entry, int64_t generation) const {
+    if (unit.generation && generation != unit.generation) return false;
+    return !entry || entry->generation == generation;
+}
+
+// Whether an entry may be served without asking GCS if it changed. Reads of
+// an explicit generation never need to ask: that generation cannot change.
+bool GCSCache::fresh(const CacheUnit& unit, const CacheEntry& entry) const {
+    if (unit.generation) return entry.generation == unit.generation;
+    const ConsistencyConfig& consistency = consistency_for(unit.bucket);
+    if (consistency.mode == "immutable") return true;
+    if (consistency.mode == "strong") return false;
+    return std::chrono::steady_clock::now() < entry.fresh_until;
+}
+
+const ConsistencyConfig& GCSCache::consistency_for(const std::string& bucket) const {
+    auto it = config_.bucket_consistency.find(bucket);
+    return it != config_.bucket_consistency.end() ? it->second : config_.consistency;
+}
+
+bool GCSCache::compressed(const std::string& bucket) const {
+    auto it = config_.bucket_compression.find(bucket);
+    return it != config_.bucket_compression.end() ? it->second : config_.compression;
+}
+
+// compression_level scaled down by how busy the CPUs are, so compressing
+// fills does not take the CPU serving needs. Never below 1.
+int GCSCache::compression_level() const {
+    double load;
+    unsigned cpus = std::thread::hardware_concurrency();
+    if (cpus == 0 || ::getloadavg(&load, 1) != 1) return config_.compression_level;
+    double headroom = std::clamp(1.0 - load / cpus, 0.0, 1.0);
+    return std::max(1, static_cast<int>(std::lround(config_.compression_level * headroom)));
+}
+
+// Asks GCS whether the object behind a cached entry has moved past
+// generation, with a read that only returns data if it has. If not, the
+// entry is served as it is; if so, that same read refills it.
+std::shared_ptr<ObjectReader> GCSCache::revalidate(const CacheUnit& unit, int64_t generation) {
+    const std::string& cache_key = unit.key;
+    CacheShard& shard = shard_for(cache_key);
+    auto reader = std::make_shared<gcs::ObjectReadStream>(
+        unit.ranged() ? storage_client_.ReadObject(unit.bucket, unit.file, gcs::ReadRange(unit.range_begin, unit.range_end),
+                                                   gcs::IfGenerationNotMatch(generation))
+                      : storage_client_.ReadObject(unit.bucket, unit.file, gcs::IfGenerationNotMatch(generation)));
+    auto code = reader->status().code();
+
+    if (code == google::cloud::StatusCode::kFailedPrecondition) {
+        // 304: still the generation we have
+        ++revalidated_;
+        {
+            std::lock_guard<std::mutex> lock(shard.mutex);
+            CacheEntry* entry = shard.find(cache_key);
+            if (entry && entry->generation == generation) {
+                entry->fresh_until = std::chrono::steady_clock::now() +
+                                     std::chrono::seconds(consistency_for(unit.bucket).ttl_sec);
+            }
+        }
+        LOG(INFO) << "[CACHE] REVALIDATED: " << cache_key << " is still generation " << generation << "\n";
+        return get_or_fetch(unit, true);
+    }
+
+    if (code != google::cloud::StatusCode::kOk && code != google::cloud::StatusCode::kNotFound) {
+        // Serving the copy we have beats failing while GCS is unreachable
+        LOG(WARNING) << "[CACHE] Revalidating " << cache_key << " failed: " << reader->status().message()
+                     << ", serving the cached copy\n";
+        return get_or_fetch(unit, true);
+    }
+
+    // Changed or deleted: the cached copy must go either way
+    ++stale_;
+    std::shared_ptr<InFlightFill> fill;
+    bool leader = false;
+    {
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        const CacheEntry* entry = shard.find(cache_key);
+        if (entry && entry->generation == generation) {
+            LOG(INFO) << "[CACHE] STALE: " << cache_key << " moved past generation " << generation << "\n";
+            remove_evicted(shard, cache_key, shard.erase(cache_key));
+        }
+        if (code == google::cloud::StatusCode::kOk) {
+            auto it = shard.in_flight.find(cache_key);
+            if (it != shard.in_flight.end()) {
+                fill = it->second;
+            } else {
+                fill = std::make_shared<InFlightFill>();
+                shard.in_flight.emplace(cache_key, fill);
+                leader = true;
+            }
+        }
+    }
+    if (code == google::cloud::StatusCode::kNotFound) {
+        not_found(unit.bucket, unit.file, unit.generation, reader->status().message());
+    }
+
+    if (!leader) {
+        reader.reset();
+        auto joined = join_fill(cache_key, fill);
+        if (joined) return joined;
+        return get_or_fetch(unit, true);
+    }
+    ++misses_;
+    return lead_fill(unit, fill, std::move(reader));
+}
+
+// Starts the fill this caller registered in the shard's in_flight map, and
+// fails it for anyone who joined if it cannot start.
+std::shared_ptr<ObjectReader> GCSCache::lead_fill(const CacheUnit& unit, const std::shared_ptr<InFlightFill>& fill,
+                                                  std::shared_ptr<gcs::ObjectReadStream> reader) {
+    try {
+        return start_fill(unit, config_.cache_dir + "/" + unit.key, fill, std::move(reader));
+    } catch (const std::exception& e) {
+        {
+            CacheShard& shard = shard_for(unit.key);
+            std::lock_guard<std::mutex> lock(shard.mutex);
+            shard.in_flight.erase(unit.key);
+        }
+        finish_fill(fill, *e.what() ? e.what() : "Fill failed for " + unit.key,
+                    dynamic_cast<const ObjectNotFound*>(&e) != nullptr);
+        throw;
+    }
+}
+
+// Copies a hot disk entry into the RAM tier and serves it from there. Falls
+// back to the open file if the tier has no room.
+std::shared_ptr<ObjectReader> GCSCache::promote_to_ram(CacheShard& shard, const std::string& key,
+                                                     std::shared_ptr<ObjectReader> reader, size_t size,
+                                                     int64_t generation) {
+    auto data = std::make_shared<std::string>(size, '\0');
+    size_t copied = 0;
+    while (copied < size) {
+        size_t bytes_read = reader->read(data->data() + copied, size - copied);
+        if (bytes_read == 0) break;
+        copied += bytes_read;
+    }
+    if (copied == size) {
+        // Insert under the shard lock so an eviction of the disk copy cannot
+        // slip in between and leave an orphaned RAM copy, or a refill leave
+        // one of an older generation
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        const CacheEntry* entry = shard.find(key);
+        if (entry && entry->generation == generation && ram_tier_.insert(key, data, generation)) {
+            return std::make_shared<ObjectReader>(std::move(data));
+        }
+    }
+    reader->seek(0);
+    return reader;
+}
+
+// Opens the upstream object and the .tmp file, then hands the copy to a
+// background thread so the caller can start streaming right away.
+std::shared_ptr<ObjectReader> GCSCache::start_fill(const CacheUnit& unit, const std::string& local_path,
+                                                   const std::shared_ptr<InFlightFill>& fill,
+                                                   std::shared_ptr<gcs::ObjectReadStream> reader) {
+    const std::string& cache_key = unit.key;
     if (!reader) {
-        LOG(ERROR) << "ReadObject error: " << file << " is not in bucket " << bucket << "\n";
-        throw std::runtime_error(reader.status().message());
+        auto generation = unit.generation ? gcs::Generation(unit.generation) : gcs::Generation();
+        reader = std::make_shared<gcs::ObjectReadStream>(
+            unit.ranged() ? storage_client_.ReadObject(unit.bucket, unit.file,
+                                                       gcs::ReadRange(unit.range_begin, unit.range_end), generation)
+                          : storage_client_.ReadObject(unit.bucket, unit.file, generation));
     }
+    if (!*reader) {
+        if (reader->status().code() == google::cloud::StatusCode::kNotFound) {
+            not_found(unit.bucket, unit.file, unit.generation, reader->status().message());
+        }
+        LOG(ERROR) << "ReadObject error: " << unit.file << " is not in bucket " << unit.bucket << "\n";
+        throw std::runtime_error(reader->status().message());
+    }
+
+    // A fill that finds a newer generation than the metadata cache has
+    // means the size there is stale too
+    if (!unit.generation) {
+        std::string metadata_key = unit.bucket + "/" + unit.file;
+        auto cached = metadata_.get(metadata_key);
+        if (cached && cached->generation != reader->generation().value_or(cached->generation)) {
+            metadata_.erase(metadata_key);
+        }
+    }
+
+    // size() is the whole object's, even for a ranged read. Not every
+    // response carries it; the metadata cache then does.
+    uint64_t total_size = reader->size() ? *reader->size()
+                                         : object_metadata(unit.bucket, unit.file, unit.generation).size;
+    size_t object_size = total_size;
+    if (unit.ranged()) {
+        uint64_t end = std::min<uint64_t>(unit.range_end, total_size);
+        object_size = end > static_cast<uint64_t>(unit.range_begin) ? end - unit.range_begin : 0;
+    }
+    if (!unit.skip_admission && !admit(cache_key, object_size)) {
+        // Not worth the eviction victim's place: stream it through and let
+        // anyone waiting on this fill make their own decision
+        LOG(INFO) << "[CACHE] BYPASS: " << cache_key << " not admitted\n";
+        ++bypassed_;
+        {
+            CacheShard& shard = shard_for(cache_key);
+            std::lock_guard<std::mutex> lock(shard.mutex);
+            shard.in_flight.erase(cache_key);
+        }
+        finish_fill(fill, "");
+        return std::make_shared<ObjectReader>(reader, object_size);
+    }
+    bool in_window = config_.admission_enabled && object_size <= window_capacity_;
 
-    // Ensure bucket subdirectory exists
-    std::filesystem::create_directories(bucket_dir);
+    // Ensure the parent directory exists
+    std::filesystem::create_directories(std::filesystem::path(local_path).parent_path());
 
-    // Write to temp file first
+    // Write to temp file first; only this fill owns it
     std::string temp_path = local_path + ".tmp";
-    std::ofstream ofs(temp_path, std::ios::binary);
-    ofs << reader.rdbuf();
-    ofs.close();
+    int fd = ::open(temp_path.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) {
+        throw std::runtime_error("Failed to create " + temp_path);
+    }
+    int reader_fd = ::dup(fd);
+    if (reader_fd < 0) {
+        ::close(fd);
+        throw std::runtime_error("Failed to open " + temp_path);
+    }
+    // Best effort: lays the file out in one go instead of block by block
+    ::fallocate(fd, FALLOC_FL_KEEP_SIZE, 0, object_size);
 
-    // Get file size and apply eviction policy
-    size_t file_size = std::filesystem::file_size(temp_path);
-    evict_if_needed(file_size);
+    // The size is known up front, so the disk budget is taken before the
+    // download rather than after; run_fill gives it back if the fill fails
+    evict_if_needed(object_size);
 
-    // Finalize file
-    std::filesystem::rename(temp_path, local_path);
+    {
+        std::lock_guard<std::mutex> lock(fill->mutex);
+        fill->fd = fd;
+        fill->object_size = object_size;
+        fill->started = true;
+    }
+    fill->cond.notify_all();
 
-    // Update cache metadata
-    lru_keys_.push_front(cache_key);
-    cache_index_[cache_key] = lru_keys_.begin();
-    current_cache_size_ += file_size;
+    int64_t generation = reader->generation().value_or(0);
+    std::thread(&GCSCache::run_fill, this, reader, unit, local_path, object_size, generation, in_window, fill).detach();
+    return std::make_shared<ObjectReader>(reader_fd, fill);
+}
 
-    return local_path;
+void GCSCache::run_fill(std::shared_ptr<gcs::ObjectReadStream> reader, CacheUnit unit,
+                        const std::string& local_path, size_t object_size, int64_t generation,
+                        bool in_window, std::shared_ptr<InFlightFill> fill) {
+    const std::string& cache_key = unit.key;
+    std::string temp_path = local_path + ".tmp";
+    std::string error;
+    bool reserved = true;
+    try {
+        size_t file_size = 0;
+        uint32_t crc32c = 0;
+        if (!unit.ranged() && config_.parallel_fill_min > 0 && object_size >= config_.parallel_fill_min) {
+            fetch_parts(*reader, unit, object_size, generation, fill);
+            file_size = object_size;
+            // Parts land out of order, so checksum the file once it is whole
+            if (!crc32c_of_file(fill->fd, file_size, crc32c)) {
+                throw std::runtime_error("Failed to read back " + temp_path);
+            }
+        } else {
+            Crc32c crc;
+            FillWriter writer(fill->fd, temp_path, object_size, config_.io_uring, config_.direct_io_min);
+            auto publish_landed = [&] {
+                {
+                    std::lock_guard<std::mutex> lock(fill->mutex);
+                    if (fill->bytes_written == writer.landed()) return;
+                    fill->bytes_written = writer.landed();
+                }
+                fill->cond.notify_all();
+            };
+            while (true) {
+                size_t len;
+                char* buffer = writer.buffer(len);
+                reader->read(buffer, len);
+                size_t bytes_read = reader->gcount();
+                if (bytes_read == 0) break;
+                crc.update(buffer, bytes_read);
+                writer.commit(bytes_read);
+                file_size += bytes_read;
+                publish_landed();
+            }
+            if (!reader->status().ok()) {
+                throw std::runtime_error("Download failed: " + reader->status().message());
+            }
+            writer.finish();
+            publish_landed();
+            crc32c = crc.value();
+        }
+        if (file_size != object_size) {
+            throw std::runtime_error("Download of " + cache_key + " ended at " + std::to_string(file_size) +
+                                     " of " + std::to_string(object_size) + " bytes");
+        }
+        // GCS hashes cover the whole object, so blocks are only checksummed
+        // for the scrubber
+        auto expected = unit.ranged() ? std::nullopt : Crc32c::from_hash_header(reader->received_hash());
+        if (expected && *expected != crc32c) {
+            ++corrupt_;
+            throw std::runtime_error("CRC32C mismatch for " + cache_key + ": GCS has " +
+                                     std::to_string(*expected) + ", got " + std::to_string(crc32c));
+        }
+        // publish_fill gives the reservation back itself if it fails
+        reserved = false;
+        publish_fill(unit, local_path, file_size, generation, reader->metageneration().value_or(0), in_window, crc32c);
+    } catch (const std::exception& e) {
+        LOG(ERROR) << "[CACHE] Fill of " << cache_key << " failed: " << e.what() << "\n";
+        if (reserved) current_cache_size_ -= object_size;
+        error = *e.what() ? e.what() : "Fill failed for " + cache_key;
+        std::error_code ec;
+        std::filesystem::remove(temp_path, ec);
+        CacheShard& shard = shard_for(cache_key);
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        shard.in_flight.erase(cache_key);
+    }
+    finish_fill(fill, error);
 }
 
+// Fetches a large object as parallel_part_size ranges over up to
+// parallel_streams connections, pwrite'ing each into the .tmp file. The
+// stream start_fill already opened reads parts from the front for as long as
+// the next one is unclaimed; the other connections take parts from the back
+// as ranged reads pinned to its generation, so that stream never has to skip
+// ahead. bytes_written only advances over the contiguous prefix, so readers
+// following the fill still see it in order.
+void GCSCache::fetch_parts(gcs::ObjectReadStream& first, const CacheUnit& unit, size_t object_size,
+                           int64_t generation, const std::shared_ptr<InFlightFill>& fill) {
+    size_t part_size = config_.parallel_part_size;
+    size_t part_count = (object_size + part_size - 1) / part_size;
+    std::vector<size_t> part_written(part_count, 0); // guarded by fill->mutex
+    size_t prefix_parts = 0;
+    std::mutex claim_mutex;
+    size_t front = 1, back = part_count;  // unclaimed parts, guarded by claim_mutex
+    std::atomic<bool> failed(false);
+    std::mutex error_mutex;
+    std::string error;
+
+    auto claim = [&](bool from_front, size_t& index) {
+        std::lock_guard<std::mutex> lock(claim_mutex);
+        if (front >= back) return false;
+        index = from_front ? front++ : --back;
+        return true;
+    };
+
+    // stream is null for a part to fetch with a ranged read of its own
+    auto fetch = [&](size_t index, gcs::ObjectReadStream* stream) {
+        size_t begin = index * part_size;
+        size_t length = std::min(part_size, object_size - begin);
+        std::unique_ptr<gcs::ObjectReadStream> ranged;
+        if (!stream) {
+            ranged = std::make_unique<gcs::ObjectReadStream>(storage_client_.ReadObject(
+                unit.bucket, unit.file, gcs::ReadRange(begin, begin + length),
+                generation ? gcs::Generation(generation) : gcs::Generation()));
+            if (!*ranged) {
+                throw std::runtime_error(ranged->status().message());
+            }
+            stream = ranged.get();
+        }
+
+        char buffer[Constants::StreamBufferSize];
+        size_t copied = 0;
+        while (copied < length && !failed) {
+            stream->read(buffer, std::min(sizeof(buffer), length - copied));
+            size_t bytes_read = stream->gcount();
+            if (bytes_read == 0) break;
+            if (!pwrite_all(fill->fd, buffer, bytes_read, begin + copied)) {
+                throw std::runtime_error("Failed to write " + config_.cache_dir + "/" + unit.key + ".tmp");
+            }
+            copied += bytes_read;
+            {
+                std::lock_guard<std::mutex> lock(fill->mutex);
+                part_written[index] = copied;
+                while (prefix_parts < part_count &&
+                       part_written[prefix_parts] == std::min(part_size, object_size - prefix_parts * part_size)) {
+                    ++prefix_parts;
+                }
+                fill->bytes_written = prefix_parts < part_count
+                    ? prefix_parts * part_size + part_written[prefix_parts] : object_size;
+            }
+            fill->cond.notify_all();
+        }
+        if (copied < length && !failed) {
+            throw std::runtime_error("Download of part " + std::to_string(index) + " failed: " +
+                                     stream->status().message());
+        }
+    };
+
+    auto worker = [&](bool first_stream) {
+        try {
+            gcs::ObjectReadStream* stream = first_stream ? &first : nullptr;
+            if (first_stream) fetch(0, stream);
+            size_t index;
+            while (!failed && claim(first_stream, index)) fetch(index, stream);
+        } catch (const std::exception& e) {
+            std::lock_guard<std::mutex> lock(error_mutex);
+            if (!failed.exchange(true)) error = e.what();
+        }
+    };
+
+    LOG(INFO) << "[CACHE] Fetching " << unit.key << " as " << part_count << " parts over "
+              << std::min(config_.parallel_streams, part_count) << " streams\n";
+    std::vector<std::thread> workers;
+    for (size_t i = 1; i < std::min(config_.parallel_streams, part_count); ++i) {
+        workers.emplace_back(worker, false);
+    }
+    worker(true);
+    for (auto& thread : workers) thread.join();
+
+    if (failed) {
+        throw std::runtime_error(error.empty() ? "Download failed for " + unit.key : error);
+    }
+}
+
+void GCSCache::publish_fill(const CacheUnit& unit, const std::string& local_path, size_t file_size,
+                            int64_t generation, int64_t metageneration, bool in_window, uint32_t crc32c) {
+    const std::string& cache_key = unit.key;
+
+    Recipe recipe;
+    size_t disk_bytes = file_size;
+    if (config_.dedup) {
+        try {
+            disk_bytes = store_chunks(local_path + ".tmp", file_size, recipe);
+        } catch (const std::exception&) {
+            current_cache_size_ -= file_size;
+            throw;
+        }
+        // Only the chunks this object added stay reserved
+        current_cache_size_ += disk_bytes;
+        current_cache_size_ -= file_size;
+    } else if (compressed(unit.bucket)) {
+        disk_bytes = compress_fill(local_path + ".tmp", file_size);
+        current_cache_size_ += disk_bytes;
+        current_cache_size_ -= file_size;
+    }
+
+    // Finalize file and update cache metadata in one step, so a request
+    // sees the key either in flight or cached
+    {
+        CacheShard& shard = shard_for(cache_key);
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        // The recipe being replaced still holds references to its chunks
+        int old_recipe_fd = config_.dedup && shard.contains(cache_key) ? ::open(local_path.c_str(), O_RDONLY) : -1;
+        std::error_code ec;
+        std::filesystem::rename(local_path + ".tmp", local_path, ec);
+        if (ec) {
+            if (old_recipe_fd >= 0) ::close(old_recipe_fd);
+            if (config_.dedup) chunk_store_.release(recipe);
+            current_cache_size_ -= disk_bytes;
+            throw std::runtime_error("Failed to publish " + cache_key + ": " + ec.message());
+        }
+        bool replacing = shard.contains(cache_key);
+        // What is in cache_dir now; in dedup mode, the recipe
+        size_t file_bytes = config_.dedup ? ChunkStore::recipe_bytes(recipe) : disk_bytes;
+        // The file being replaced may be compressed, or no longer
+        size_t replaced = shard.insert(cache_key, file_size, file_bytes, generation, in_window, crc32c);
+        // A RAM copy of the replaced entry must not outlive it
+        if (replacing) ram_tier_.erase(cache_key);
+        CacheEntry* entry = shard.find(cache_key);
+        entry->metageneration = metageneration;
+        // A requested generation may not be the live one, so readers of the
+        // live object recheck it
+        if (!unit.generation) {
+            entry->fresh_until = std::chrono::steady_clock::now() +
+                                 std::chrono::seconds(consistency_for(unit.bucket).ttl_sec);
+        }
+        if (config_.dedup) {
+            replaced = old_recipe_fd >= 0 ? release_recipe(old_recipe_fd) : 0;
+            if (old_recipe_fd >= 0) ::close(old_recipe_fd);
+        }
+        current_cache_size_ -= replaced;
+        journal_.record_add(IndexRecord{cache_key, file_size, file_bytes, generation, crc32c});
+        shard.in_flight.erase(cache_key);
+    }
+    negative_.erase(unit.bucket + "/" + unit.file);
+
+    if (journal_.pending_records() >= Constants::JournalCompactRecords) {
+        compact_index();
+    }
+}
+
+// Cuts a finished fill into content-defined chunks and stores them, then
+// swaps the .tmp file for the object's recipe. Returns the disk bytes this
+// added, which for a near-duplicate is little more than the recipe.
+size_t GCSCache::store_chunks(const std::string& tmp_path, size_t file_size, Recipe& recipe) {
+    int fd = ::open(tmp_path.c_str(), O_RDONLY);
+    if (fd < 0) {
+        throw std::runtime_error("Failed to open " + tmp_path);
+    }
+    void* map = file_size > 0 ? ::mmap(nullptr, file_size, PROT_READ, MAP_PRIVATE, fd, 0) : nullptr;
+    ::close(fd);
+    if (map == MAP_FAILED) {
+        throw std::runtime_error("Failed to map " + tmp_path);
+    }
+
+    recipe.size = file_size;
+    size_t added = 0;
+    try {
+        const auto* data = static_cast<const uint8_t*>(map);
+        for (size_t offset = 0; offset < file_size;) {
+            size_t length = chunker_.next_cut(data + offset, file_size - offset);
+            const char* chunk = reinterpret_cast<const char*>(data + offset);
+            std::string hash = ChunkStore::hash_chunk(chunk, length);
+            added += chunk_store_.put(hash, chunk, length);
+            recipe.chunks.push_back(ChunkRef{std::move(hash), static_cast<uint32_t>(length)});
+            offset += length;
+        }
+        // Readers following the fill hold their own descriptor of the data,
+        // so the path can be reused for the recipe
+        ::unlink(tmp_path.c_str());
+        if (!ChunkStore::write_recipe(tmp_path, recipe)) {
+            throw std::runtime_error("Failed to write recipe " + tmp_path);
+        }
+    } catch (const std::exception&) {
+        if (map) ::munmap(map, file_size);
+        chunk_store_.release(recipe);
+        throw;
+    }
+    if (map) ::munmap(map, file_size);
+    return added + ChunkStore::recipe_bytes(recipe);
+}
+
+// Rewrites a finished fill's .tmp file as seekable zstd, unless it does not
+// compress. Returns the disk bytes it now takes. Failing to compress keeps
+// the raw file rather than failing the fill.
+size_t GCSCache::compress_fill(const std::string& tmp_path, size_t file_size) {
+    int fd = ::open(tmp_path.c_str(), O_RDONLY);
+    if (fd < 0) return file_size;
+    void* map = file_size > 0 ? ::mmap(nullptr, file_size, PROT_READ, MAP_PRIVATE, fd, 0) : nullptr;
+    ::close(fd);
+    if (!map || map == MAP_FAILED) return file_size;
+
+    // Ends in .tmp, so reconcile_cache_dir never adopts a leftover one
+    std::string zst_path = tmp_path.substr(0, tmp_path.size() - 4) + ".zst.tmp";
+    size_t disk_bytes = file_size;
+    try {
+        int level = compression_level();
+        // Readers following the fill hold their own descriptor of the raw
+        // file, so it can be replaced under them
+        if (SeekableZstd::compress(static_cast<const char*>(map), file_size, level, zst_path)) {
+            if (::rename(zst_path.c_str(), tmp_path.c_str()) == 0) {
+                disk_bytes = disk_bytes_of(tmp_path, file_size);
+            } else {
+                ::unlink(zst_path.c_str());
+            }
+        } else {
+            LOG(INFO) << "[CACHE] " << tmp_path << " does not compress, storing it raw\n";
+        }
+    } catch (const std::exception& e) {
+        LOG(WARNING) << "[CACHE] Compressing " << tmp_path << " failed, storing it raw: " << e.what() << "\n";
+    }
+    ::munmap(map, file_size);
+    return disk_bytes;
+}
+
+// Drops the chunk references of the recipe open at fd. Returns the disk
+// bytes this frees, the recipe file included.
+size_t GCSCache::release_recipe(int fd) {
+    struct stat st;
+    size_t recipe_size = ::fstat(fd, &st) == 0 ? st.st_size : 0;
+    Recipe recipe;
+    if (!ChunkStore::read_recipe(fd, recipe)) return recipe_size;
+    return chunk_store_.release(recipe) + recipe_size;
+}
+
+void GCSCache::finish_fill(const std::shared_ptr<InFlightFill>& fill, const std::string& error, bool not_found) {
+    {
+        std::lock_guard<std::mutex> lock(fill->mutex);
+        fill->done = true;
+        fill->error = error;
+        fill->not_found = not_found;
+        if (fill->fd >= 0) {
+            ::close(fill->fd);
+            fill->fd = -1;
+        }
+    }
+    fill->cond.notify_all();
+}
+
+// Waits until the fill has its .tmp file open and returns a reader on it, or
+// nullptr if the fill already finished and the object can be opened directly.
+std::shared_ptr<ObjectReader> GCSCache::join_fill(const std::string& cache_key, const std::shared_ptr<InFlightFill>& fill) {
+    LOG(INFO) << "[CACHE] JOIN: " << cache_key << ", streaming from in-flight fill\n";
+    std::unique_lock<std::mutex> lock(fill->mutex);
+    fill->cond.wait(lock, [&] { return fill->started || fill->done; });
+    if (!fill->error.empty()) {
+        if (fill->not_found) throw ObjectNotFound(fill->error);
+        throw std::runtime_error(fill->error);
+    }
+    if (fill->fd < 0) return nullptr;
+
+    int fd = ::dup(fill->fd);
+    if (fd < 0) {
+        throw std::runtime_error("Failed to join fill for " + cache_key);
+    }
+    return std::make_shared<ObjectReader>(fd, fill);
+}
+
+CacheShard& GCSCache::shard_for(const std::string& key) {
+    return *shards_[std::hash<std::string>{}(key) % shards_.size()];
+}
+
+CacheShard& GCSCache::largest_shard(size_t (CacheShard::*bytes)() const) const {
+    return **std::max_element(shards_.begin(), shards_.end(), [&](const auto& a, const auto& b) {
+        return ((*a).*bytes)() < ((*b).*bytes)();
+    });
+}
+
+size_t GCSCache::window_bytes() const {
+    size_t total = 0;
+    for (const auto& shard : shards_) total += shard->window_bytes();
+    return total;
+}
+
+// Decides whether an object too big for the admission window may displace
+// the main cache's eviction victim. Anything fits while there is room, or
+// while consumed manifest objects can make room.
+bool GCSCache::admit(const std::string& cache_key, size_t size) {
+    if (!config_.admission_enabled || size <= window_capacity_) return true;
+    if (current_cache_size_ + size <= config_.max_disk_cache_size) return true;
+    {
+        std::lock_guard<std::mutex> lock(consumed_mutex_);
+        if (!consumed_keys_.empty()) return true;
+    }
+
+    CacheShard& shard = largest_shard(&CacheShard::size_bytes);
+    std::string victim;
+    {
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        if (!shard.peek_victim(victim)) return true;
+    }
+    return sketch_.frequency(cache_key) > sketch_.frequency(victim);
+}
+
+// Takes incoming_file_size out of the disk budget. Eviction normally
+// happens in the background between the watermarks; only past max_disk
+// does the caller evict for itself. Must be called without holding any
+// shard lock.
 void GCSCache::evict_if_needed(size_t incoming_file_size) {
-    while (current_cache_size_ + incoming_file_size > config_.max_disk_cache_size && !lru_keys_.empty()) {
-        LOG(INFO) << "[CACHE] EVICTING, not enough disk space: " << current_cache_size_ << " + " << incoming_file_size << " > " << config_.max_disk_cache_size << "\n";
-        std::string lru_key = lru_keys_.back();
-        std::string file_path = config_.cache_dir + "/" + lru_key;
-        size_t size_removed = std::filesystem::file_size(file_path);
-        std::filesystem::remove(file_path);
-        LOG(INFO) << "[CACHE] EVICTED: " << file_path << " (" << size_removed << " bytes)\n";
-        lru_keys_.pop_back();
-        cache_index_.erase(lru_key);
-        current_cache_size_ -= size_removed;
+    current_cache_size_ += incoming_file_size;
+    if (evictor_) evictor_->notify();
+    while (current_cache_size_ > config_.max_disk_cache_size) {
+        LOG(INFO) << "[CACHE] EVICTING, not enough disk space: " << current_cache_size_ << " > " << config_.max_disk_cache_size << "\n";
+        if (!evict_step()) break;
+    }
+}
+
+// Evicts one entry: a consumed manifest object first, then whatever the
+// admission and eviction policies pick. Returns false if the cache is empty.
+bool GCSCache::evict_step() {
+    if (evict_consumed()) return true;
+    bool window_full = config_.admission_enabled && window_bytes() > window_capacity_;
+    return window_full ? evict_from_window() : evict_one();
+}
+
+// Evicts the oldest object a manifest client has read past, if any is
+// still cached.
+bool GCSCache::evict_consumed() {
+    while (true) {
+        std::string key;
+        {
+            std::lock_guard<std::mutex> lock(consumed_mutex_);
+            if (consumed_keys_.empty()) return false;
+            key = std::move(consumed_keys_.front());
+            consumed_keys_.pop_front();
+        }
+
+        CacheShard& shard = shard_for(key);
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        size_t size = shard.erase(key);
+        if (size == 0) continue;
+        LOG(INFO) << "[CACHE] CONSUMED: " << key << "\n";
+        remove_evicted(shard, key, size);
+        return true;
+    }
+}
+
+// Evicts the policy's victim from the largest shard, so shards that grew
+// past their share of max_disk give space back first.
+bool GCSCache::evict_one() {
+    std::vector<CacheShard*> by_size;
+    for (auto& shard : shards_) by_size.push_back(shard.get());
+    std::sort(by_size.begin(), by_size.end(), [](CacheShard* a, CacheShard* b) {
+        return a->size_bytes() > b->size_bytes();
+    });
+
+    for (CacheShard* shard : by_size) {
+        std::lock_guard<std::mutex> lock(shard->mutex);
+        std::string victim;
+        size_t size_removed;
+        if (!shard->pop_victim(victim, size_removed)) continue;
+        remove_evicted(*shard, victim, size_removed);
+        return true;
+    }
+    return false;
+}
+
+// The window's LRU entry duels the main cache's victim in the same shard:
+// the one the sketch has seen more often stays. Ties go to the incumbent, so a
+// scan of one-off objects cannot flush the main cache.
+bool GCSCache::evict_from_window() {
+    CacheShard& shard = largest_shard(&CacheShard::window_bytes);
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    std::string candidate, victim;
+    if (!shard.peek_window_lru(candidate)) return false;
+
+    bool has_victim = shard.peek_victim(victim);
+    if (!has_victim || sketch_.frequency(candidate) > sketch_.frequency(victim)) {
+        LOG(INFO) << "[CACHE] ADMITTED: " << candidate << "\n";
+        shard.promote_window_lru();
+        if (!has_victim) return true;
+        size_t size_removed;
+        shard.pop_victim(victim, size_removed);
+        remove_evicted(shard, victim, size_removed);
+        return true;
     }
+
+    size_t size_removed;
+    shard.pop_window_lru(candidate, size_removed);
+    remove_evicted(shard, candidate, size_removed);
+    return true;
 }
 
-bool GCSCache::is_cached(const std::string& key) {
-    return cache_index_.find(key) != cache_index_.end() && std::filesystem::exists(config_.cache_dir + "/" + key);
+// Drops an entry already taken out of the shard index; disk_size is what
+// its file took. Runs under the shard lock so a concurrent refill of the
+// same key cannot publish its file before this removal.
+void GCSCache::remove_evicted(CacheShard& shard, const std::string& key, size_t disk_size) {
+    std::string file_path = config_.cache_dir + "/" + key;
+    ram_tier_.erase(key);
+    if (config_.dedup) {
+        // Chunks other objects still use stay, so this may free little
+        int fd = ::open(file_path.c_str(), O_RDONLY);
+        disk_size = fd >= 0 ? release_recipe(fd) : 0;
+        if (fd >= 0) ::close(fd);
+    }
+    std::string trash_path = config_.cache_dir + "/.trash/" + std::to_string(trash_seq_++);
+    if (::rename(file_path.c_str(), trash_path.c_str()) == 0) deletions_->push(std::move(trash_path));
+    journal_.record_remove(key);
+    current_cache_size_ -= disk_size;
+    LOG(INFO) << "[CACHE] EVICTED: " << file_path << " (" << disk_size << " bytes)\n";
+}
+
+// Opens a cached object for reading, or returns nullptr if it is not cached.
+// The caller holds the shard lock, which keeps eviction from unlinking the
+// file, or in dedup mode releasing its chunks, before they are open or
+// pinned. A compressed file is read decompressed, unless raw asks for it as
+// it is stored. A file that is not the size its entry recorded, say one a
+// crash cut short, is evicted so the caller fills it again.
+std::shared_ptr<ObjectReader> GCSCache::open_cached(CacheShard& shard, const std::string& key, bool raw) {
+    const CacheEntry* entry = shard.find(key);
+    if (!entry) return nullptr;
+    std::string path = config_.cache_dir + "/" + key;
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0) return nullptr;
+    if (!config_.dedup) {
+        struct stat st;
+        if (::fstat(fd, &st) != 0) {
+            ::close(fd);
+            return nullptr;
+        }
+        if (static_cast<size_t>(st.st_size) != entry->disk_size) {
+            ::close(fd);
+            LOG(WARNING) << "[CACHE] CORRUPT: " << key << " is " << st.st_size << " bytes on disk, expected "
+                         << entry->disk_size << ", evicting\n";
+            ++corrupt_;
+            remove_evicted(shard, key, shard.erase(key));
+            return nullptr;
+        }
+        if (entry->disk_size == entry->size) return std::make_shared<ObjectReader>(fd, nullptr);
+        if (!raw) return open_compressed(fd, st.st_size, path);
+        auto reader = std::make_shared<ObjectReader>(fd, nullptr);
+        reader->set_content_encoding("zstd");
+        return reader;
+    }
+
+    Recipe recipe;
+    bool loaded = ChunkStore::read_recipe(fd, recipe);
+    ::close(fd);
+    if (!loaded) {
+        throw std::runtime_error("Corrupt recipe " + path);
+    }
+    chunk_store_.pin(recipe);
+    std::shared_ptr<const Recipe> pinned(new Recipe(std::move(recipe)), [this](const Recipe* r) {
+        chunk_store_.unpin(*r);
+        delete r;
+    });
+
+    std::vector<uint64_t> part_ends;
+    uint64_t end = 0;
+    for (const auto& chunk : pinned->chunks) part_ends.push_back(end += chunk.length);
+    return std::make_shared<ObjectReader>([this, pinned](size_t index) {
+        std::string chunk_path = chunk_store_.chunk_path(pinned->chunks[index].hash);
+        int chunk_fd = ::open(chunk_path.c_str(), O_RDONLY);
+        if (chunk_fd < 0) {
+            throw std::runtime_error("Failed to open chunk " + chunk_path);
+        }
+        return std::make_shared<ObjectReader>(chunk_fd, nullptr);
+    }, std::move(part_ends));
+}
+
+// Reads a compressed file frame by frame, decompressing each as the reader
+// reaches it. Takes over fd.
+std::shared_ptr<ObjectReader> GCSCache::open_compressed(int fd, size_t file_size, const std::string& path) {
+    std::shared_ptr<int> file(new int(fd), [](int* f) {
+        ::close(*f);
+        delete f;
+    });
+    auto frames = std::make_shared<std::vector<SeekableZstd::Frame>>();
+    if (!SeekableZstd::read_frames(fd, file_size, *frames)) {
+        throw std::runtime_error("Corrupt compressed file " + path);
+    }
+    std::vector<uint64_t> part_ends;
+    uint64_t end = 0;
+    for (const auto& frame : *frames) part_ends.push_back(end += frame.size);
+    return std::make_shared<ObjectReader>([file, frames](size_t index) {
+        return std::make_shared<ObjectReader>(SeekableZstd::read_frame(*file, (*frames)[index]));
+    }, std::move(part_ends));
+}
+
+// Entries with a recorded checksum, coldest first across all shards
+std::vector<std::string> GCSCache::scrub_candidates() {
+    std::vector<std::vector<std::string>> by_shard;
+    for (auto& shard : shards_) {
+        std::vector<std::string> keys;
+        std::lock_guard<std::mutex> lock(shard->mutex);
+        shard->for_each_lru([&](const std::string& key, const CacheEntry& entry) {
+            if (entry.crc32c) keys.push_back(key);
+        });
+        by_shard.push_back(std::move(keys));
+    }
+    // Interleave, so the coldest entries of every shard come first
+    std::vector<std::string> keys;
+    bool more = true;
+    for (size_t rank = 0; more; ++rank) {
+        more = false;
+        for (auto& shard_keys : by_shard) {
+            if (rank >= shard_keys.size()) continue;
+            keys.push_back(std::move(shard_keys[rank]));
+            more = true;
+        }
+    }
+    return keys;
+}
+
+// Re-reads one entry and evicts it if it no longer matches the CRC32C taken
+// when it was filled. Returns the bytes read.
+size_t GCSCache::scrub_entry(const std::string& key) {
+    CacheShard& shard = shard_for(key);
+    std::shared_ptr<ObjectReader> reader;
+    uint32_t expected;
+    size_t size;
+    {
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        const CacheEntry* entry = shard.find(key);
+        if (!entry || !entry->crc32c) return 0;
+        expected = *entry->crc32c;
+        size = entry->size;
+        try {
+            reader = open_cached(shard, key);
+        } catch (const std::exception&) {
+            // Unreadable recipe; counts as corrupt below
+        }
+    }
+
+    Crc32c crc;
+    size_t total = 0;
+    try {
+        char buffer[Constants::StreamBufferSize];
+        while (reader) {
+            size_t bytes_read = reader->read(buffer, sizeof(buffer));
+            if (bytes_read == 0) break;
+            crc.update(buffer, bytes_read);
+            total += bytes_read;
+        }
+    } catch (const std::exception&) {
+        reader.reset();
+    }
+    if (reader && total == size && crc.value() == expected) return total;
+
+    if (config_.dedup) {
+        // Find the chunks at fault, so refills write them again instead of
+        // sharing them
+        int fd = ::open((config_.cache_dir + "/" + key).c_str(), O_RDONLY);
+        Recipe recipe;
+        if (fd >= 0 && ChunkStore::read_recipe(fd, recipe)) {
+            for (const auto& chunk : recipe.chunks) chunk_store_.verify(chunk.hash);
+        }
+        if (fd >= 0) ::close(fd);
+    }
+
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    const CacheEntry* entry = shard.find(key);
+    // A refill since the check replaced what was checked
+    if (!entry || entry->crc32c != expected) return total;
+    LOG(WARNING) << "[CACHE] CORRUPT: " << key << " read " << total << " of " << size
+                 << " bytes not matching its CRC32C, evicting\n";
+    ++corrupt_;
+    size_t size_removed = shard.erase(key);
+    remove_evicted(shard, key, size_removed);
+    return total;
+}
+
+CacheStats GCSCache::stats() const {
+    size_t logical_bytes = 0;
+    for (const auto& shard : shards_) logical_bytes += shard->size_bytes();
+    return CacheStats{hits_, ram_hits_, misses_, bypassed_, prefetched_, corrupt_, revalidated_, stale_,
+                      negative_hits_, current_cache_size_, logical_bytes};
 }
 
 RamTracker& GCSCache::ram_tracker() {
     return ram_tracker_;
+}
+
+BufferPool& GCSCache::buffer_pool() {
+    return buffer_pool_;
 }
\ No newline at end of file
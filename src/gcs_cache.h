@@ -2,32 +2,244 @@
 #include "config.h"
 #include "client.h"
 #include <google/cloud/storage/client.h>
+#include <atomic>
 #include <mutex>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <stdexcept>
 #include <unordered_map>
-#include <list>
+#include <vector>
+#include "cache_shard.h"
+#include "chunk_store.h"
+#include "chunker.h"
+#include "frequency_sketch.h"
+#include "index_journal.h"
+#include "metadata_cache.h"
+#include "negative_cache.h"
+#include "object_reader.h"
+#include "ram_tier.h"
 #include "ram_tracker.h"
+#include "buffer_pool.h"
+
+// A download in progress for one cache key. The first request that misses
+// starts it; later requests for the same key join it and read the .tmp file
+// up to bytes_written while it grows.
+struct InFlightFill {
+    std::mutex mutex;
+    std::condition_variable cond;
+    bool started = false;      // upstream opened and fd is readable
+    bool done = false;
+    int fd = -1;               // .tmp file, closed once the fill is published
+    size_t bytes_written = 0;
+    size_t object_size = 0;    // expected final size, known once started
+    std::string error;
+    bool not_found = false;    // error is GCS not having the object
+};
+
+// GCS has no such object, or not the generation asked for
+class ObjectNotFound : public std::runtime_error {
+public:
+    using std::runtime_error::runtime_error;
+};
+
+// The unit the cache stores and fills: a whole object, or in block mode one
+// fixed-size block of it. key doubles as the path under cache_dir.
+struct CacheUnit {
+    std::string bucket;
+    std::string file;
+    std::string key;
+    int64_t range_begin = 0;
+    int64_t range_end = -1;     // exclusive; -1 for the whole object
+    int64_t generation = 0;     // requested generation; 0 for the live one
+    bool accept_zstd = false;   // a compressed copy may be served as it is stored
+    bool skip_admission = false; // asked for outright, so cached even if admission would refuse it
+
+    bool ranged() const { return range_end >= 0; }
+};
+
+struct CacheStats {
+    size_t hits;
+    size_t ram_hits;
+    size_t misses;
+    size_t bypassed;
+    size_t prefetched;
+    size_t corrupt;         // fills and cached entries that failed their CRC32C
+    size_t revalidated;     // entries GCS confirmed unchanged
+    size_t stale;           // entries found changed or deleted in GCS
+    size_t negative_hits;   // requests answered 404 from the negative cache
+    size_t disk_bytes;
+    size_t logical_bytes;   // what disk_bytes would be without dedup or compression
+};
+
+class Readahead;
+class WarmupJobs;
+class ManifestPrefetcher;
+class Scrubber;
+class DeletionQueue;
+class Evictor;
 
 class GCSCache {
 public:
     explicit GCSCache(const Config& config);
+    ~GCSCache();
 
     RamTracker& ram_tracker();
-    std::shared_ptr<Client> get_client(const QosConfig& qos);
+    BufferPool& buffer_pool();
+    std::shared_ptr<Client> get_client(const std::string& client_id, const QosConfig& qos);
+
+    // A nonzero generation asks for that generation of the object, which
+    // is served from cache without rechecking it with GCS. With accept_zstd,
+    // a copy cached compressed comes back still compressed, its reader's
+    // content_encoding() saying so.
+    std::shared_ptr<ObjectReader> get_or_fetch_object(const std::string& file, const std::string& bucket,
+                                                      const std::string& client_id, int64_t generation = 0,
+                                                      bool accept_zstd = false);
+    std::shared_ptr<ObjectReader> get_object_for_range(const std::string& file, const std::string& bucket,
+                                                       const std::string& client_id, int64_t generation = 0);
+
+    // Metadata of the live object, or of generation when one is named. The
+    // live object's is kept as long as its bucket's consistency keeps
+    // cached data without asking GCS.
+    ObjectMetadata object_metadata(const std::string& bucket, const std::string& file, int64_t generation = 0);
+
+    // Fills an object, or in block mode all its blocks, as a prefetch and
+    // returns the bytes fetched. Admission is skipped: a warm-up is asked for
+    // by an operator or a manifest. Throws if a fill fails.
+    uint64_t warm_object(const std::string& file, const std::string& bucket);
+    // Calls fn with the name and size of each object under prefix as the
+    // listing pages in, until fn returns false. Throws if listing fails.
+    void list_objects(const std::string& bucket, const std::string& prefix,
+                      const std::function<bool(const std::string&, uint64_t)>& fn);
+    WarmupJobs& warmup_jobs();
+    ManifestPrefetcher& manifests();
 
-    std::string get_or_fetch_object(const std::string& file, const std::string& bucket);
+    // Forgets that objects were missing: one object, a whole bucket with an
+    // empty file, or everything with both empty. Returns how many.
+    size_t purge_negative(const std::string& bucket, const std::string& file);
+
+    CacheStats stats() const;
 
 private:
     Config config_;
     RamTracker ram_tracker_;
+    RamTier ram_tier_;
+    BufferPool buffer_pool_;
     
     google::cloud::storage::Client storage_client_;
 
-    std::mutex cache_mutex_;
-    size_t current_cache_size_;
-    std::unordered_map<std::string, std::list<std::string>::iterator> cache_index_;
-    std::list<std::string> lru_keys_;
+    // The index is hash-partitioned; each shard has its own lock and LRU,
+    // downloads run without holding any of them. max_disk is enforced on
+    // the sum of all shards.
+    std::vector<std::unique_ptr<CacheShard>> shards_;
+    std::atomic<size_t> current_cache_size_;
+
+    // Evicted files are renamed into cache_dir/.trash under the shard lock
+    // and unlinked from here, so a refill of the key that publishes right
+    // after cannot lose its new file to a late unlink
+    std::unique_ptr<DeletionQueue> deletions_;
+    std::atomic<uint64_t> trash_seq_{0};
+
+    // W-TinyLFU: new objects enter a small window, and the sketch decides
+    // whether one leaving the window, or one too big for it, may displace
+    // the main cache's eviction victim
+    FrequencySketch sketch_;
+    size_t window_capacity_;
+
+    std::atomic<size_t> hits_;
+    std::atomic<size_t> ram_hits_;
+    std::atomic<size_t> misses_;
+    std::atomic<size_t> bypassed_;
+    std::atomic<size_t> prefetched_;
+    std::atomic<size_t> corrupt_;
+    std::atomic<size_t> revalidated_;
+    std::atomic<size_t> stale_;
+    std::atomic<size_t> negative_hits_;
+
+    // Keyed by bucket/file. Only reads of the live object use it; a read of
+    // a named generation always asks GCS.
+    NegativeCache negative_;
+
+    // Survives restarts; rebuilt into the shards at startup
+    IndexJournal journal_;
+    std::atomic<bool> compacting_;
+
+    // Also tells block mode how many blocks an object has without asking
+    // upstream on every request
+    MetadataCache metadata_;
 
+    // Block mode only; prefetches the blocks sequential readers need next
+    std::unique_ptr<Readahead> readahead_;
+    std::unique_ptr<WarmupJobs> warmup_jobs_;
+    std::unique_ptr<ManifestPrefetcher> manifests_;
+
+    // Objects manifest clients have read past; evicted before the policy's
+    // victims
+    std::mutex consumed_mutex_;
+    std::deque<std::string> consumed_keys_;
+
+    // Dedup mode only: cache_dir/<key> holds a recipe, and disk usage is
+    // counted in chunk bytes actually stored
+    ChunkStore chunk_store_;
+    Chunker chunker_;
+
+    std::unique_ptr<Scrubber> scrubber_;
+
+    // Last, so it stops first: its thread evicts through everything above
+    std::unique_ptr<Evictor> evictor_;
+
+    CacheShard& shard_for(const std::string& key);
+    std::shared_ptr<ObjectReader> get_or_fetch(const CacheUnit& unit, bool validated = false);
+    bool fresh(const CacheUnit& unit, const CacheEntry& entry) const;
+    bool ram_current(const CacheUnit& unit, const CacheEntry* entry, int64_t generation) const;
+    const ConsistencyConfig& consistency_for(const std::string& bucket) const;
+    bool compressed(const std::string& bucket) const;
+    int compression_level() const;
+    std::shared_ptr<ObjectReader> revalidate(const CacheUnit& unit, int64_t generation);
+    std::shared_ptr<ObjectReader> get_or_fetch_blocks(const std::string& file, const std::string& bucket,
+                                                      const std::string& client_id, int64_t generation);
+    bool prefetch(const CacheUnit& unit, size_t& bytes);
+    void check_negative(const std::string& bucket, const std::string& file, int64_t generation);
+    [[noreturn]] void not_found(const std::string& bucket, const std::string& file, int64_t generation,
+                                const std::string& message);
+    ObjectMetadata remember_metadata(const std::string& bucket, const std::string& file, int64_t generation,
+                                     const google::cloud::storage::ObjectMetadata& gcs_metadata);
+    std::shared_ptr<ObjectReader> lead_fill(const CacheUnit& unit, const std::shared_ptr<InFlightFill>& fill,
+                                            std::shared_ptr<google::cloud::storage::ObjectReadStream> reader = nullptr);
+    // reader, if given, is an upstream read already opened for the unit
+    std::shared_ptr<ObjectReader> start_fill(const CacheUnit& unit, const std::string& local_path,
+                                             const std::shared_ptr<InFlightFill>& fill,
+                                             std::shared_ptr<google::cloud::storage::ObjectReadStream> reader);
+    void run_fill(std::shared_ptr<google::cloud::storage::ObjectReadStream> reader, CacheUnit unit,
+                  const std::string& local_path, size_t object_size, int64_t generation,
+                  bool in_window, std::shared_ptr<InFlightFill> fill);
+    void fetch_parts(google::cloud::storage::ObjectReadStream& first, const CacheUnit& unit, size_t object_size,
+                     int64_t generation, const std::shared_ptr<InFlightFill>& fill);
+    void publish_fill(const CacheUnit& unit, const std::string& local_path, size_t file_size,
+                      int64_t generation, int64_t metageneration, bool in_window, uint32_t crc32c);
+    size_t store_chunks(const std::string& tmp_path, size_t file_size, Recipe& recipe);
+    size_t compress_fill(const std::string& tmp_path, size_t file_size);
+    size_t release_recipe(int fd);
+    void finish_fill(const std::shared_ptr<InFlightFill>& fill, const std::string& error, bool not_found = false);
+    std::shared_ptr<ObjectReader> join_fill(const std::string& cache_key, const std::shared_ptr<InFlightFill>& fill);
+    bool admit(const std::string& cache_key, size_t size);
     void evict_if_needed(size_t incoming_file_size);
-    bool is_cached(const std::string& key);
+    bool evict_step();
+    bool evict_one();
+    bool evict_consumed();
+    void mark_consumed(const std::string& bucket, const std::string& file);
+    std::vector<std::string> scrub_candidates();
+    size_t scrub_entry(const std::string& key);
+    bool evict_from_window();
+    void remove_evicted(CacheShard& shard, const std::string& key, size_t disk_size);
+    size_t window_bytes() const;
+    CacheShard& largest_shard(size_t (CacheShard::*bytes)() const) const;
+    std::shared_ptr<ObjectReader> open_cached(CacheShard& shard, const std::string& key, bool raw = false);
+    std::shared_ptr<ObjectReader> open_compressed(int fd, size_t file_size, const std::string& path);
+    void load_index();
+    void reconcile_cache_dir(std::vector<IndexRecord> loaded);
+    void compact_index();
+    std::shared_ptr<ObjectReader> promote_to_ram(CacheShard& shard, const std::string& key,
+                                                 std::shared_ptr<ObjectReader> reader, size_t size,
+                                                 int64_t generation);
 };
-
@@ -3,12 +3,46 @@
 
 namespace Constants {
     inline constexpr size_t StreamBufferSize = 64 * 1024;
+    inline constexpr size_t SendfileSegmentSize = 1024 * 1024;
     inline constexpr int ThrottleDelayMs = 100;
     inline constexpr int BandwidthRetryDelay = 50;
+    inline constexpr size_t RamPromoteHits = 2;
+    inline constexpr size_t JournalCompactRecords = 100000;
+    inline constexpr size_t SketchAverageObjectSize = 64 * 1024;
+    inline constexpr size_t ReadaheadWorkers = 4;
+    inline constexpr size_t ReadaheadMaxStreams = 4096;
+    inline constexpr int ReadaheadStreamIdleMs = 30000;
+    inline constexpr size_t WarmupJobsKept = 64;
+    inline constexpr size_t WarmupErrorsKept = 20;
+    inline constexpr size_t ManifestPrefetchWorkers = 4;
+    inline constexpr size_t ConsumedKeysKept = 65536;
+    inline constexpr size_t CdcMinChunk = 16 * 1024;
+    inline constexpr size_t CdcAvgChunk = 64 * 1024;
+    inline constexpr size_t CdcMaxChunk = 256 * 1024;
+    inline constexpr int ScrubNice = 19;
+    inline constexpr int ScrubStartDelayMs = 60000;
+    inline constexpr int ScrubPassIntervalMs = 600000;
+    inline constexpr size_t NegativeCacheEntries = 65536;
+    inline constexpr size_t NegativeBloomBitsPerKey = 10;
+    inline constexpr size_t MetadataCacheEntries = 65536;
+    inline constexpr size_t EvictBatchSize = 64;
+    inline constexpr int EvictorPollMs = 1000;
+    inline constexpr size_t FillBufferSize = 256 * 1024;
+    inline constexpr size_t FillBuffers = 4;
+    inline constexpr size_t DirectIoAlign = 4096;
+    inline constexpr size_t BufferPoolPageSize = 4096;
+    inline constexpr size_t BufferPoolMinBuffer = 4 * 1024;
+    inline constexpr size_t BufferPoolMaxBuffer = 256 * 1024;
+    inline constexpr int BufferLeaseTimeoutSec = 30;
+    inline constexpr int RamTenantIdleSec = 300;
+    inline constexpr int RamBargeWindowUs = 1000;
+    inline constexpr size_t CompressFrameSize = 256 * 1024;
+    inline constexpr size_t CompressMaxRatioPct = 90;
 }
 
 namespace HttpStatus {
     inline constexpr int Ok = 200;
+    inline constexpr int Accepted = 202;
     inline constexpr int TooManyRequests = 429;
     inline constexpr int InternalServerError = 500;
     inline constexpr int NotFound = 404;
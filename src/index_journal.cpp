@@ -0,0 +1,306 @@
+#include "index_journal.h"
+#include <glog/logging.h>
+#include <cerrno>
+#include <cstddef>
+#include <cstring>
+#include <filesystem>
+#include <list>
+#include <unordered_map>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace {
+
+constexpr char SnapshotMagic[8] = {'M', 'R', 'P', 'H', 'I', 'D', 'X', '3'};
+
+enum RecordType : uint32_t {
+    Add = 1,
+    Remove = 2,
+};
+
+enum RecordFlags : uint32_t {
+    HasCrc32c = 1,
+};
+
+struct RecordHeader {
+    uint32_t type;
+    uint32_t key_len;
+    uint64_t size;
+    uint64_t disk_size;
+    int64_t generation;
+    uint32_t crc32c;
+    uint32_t flags;
+    uint64_t checksum;
+};
+
+struct SnapshotHeader {
+    char magic[8];
+    uint64_t count;
+};
+
+size_t padded(size_t len) {
+    return (len + 7) & ~size_t(7);
+}
+
+uint64_t fnv1a(const void* data, size_t len, uint64_t hash = 14695981039346656037ULL) {
+    auto* bytes = static_cast<const unsigned char*>(data);
+    for (size_t i = 0; i < len; ++i) {
+        hash ^= bytes[i];
+        hash *= 1099511628211ULL;
+    }
+    return hash;
+}
+
+uint64_t record_checksum(const RecordHeader& header, const char* key) {
+    uint64_t hash = fnv1a(&header, offsetof(RecordHeader, checksum));
+    return fnv1a(key, header.key_len, hash);
+}
+
+void encode_record(std::string& out, uint32_t type, const IndexRecord& record) {
+    const std::string& key = record.key;
+    RecordHeader header{type, static_cast<uint32_t>(key.size()), record.size, record.disk_size, record.generation,
+                        record.crc32c.value_or(0), record.crc32c ? HasCrc32c : 0u, 0};
+    header.checksum = record_checksum(header, key.data());
+    out.append(reinterpret_cast<const char*>(&header), sizeof(header));
+    out.append(key);
+    out.append(padded(key.size()) - key.size(), '\0');
+}
+
+bool write_all(int fd, const char* data, size_t len) {
+    while (len > 0) {
+        ssize_t written = ::write(fd, data, len);
+        if (written < 0) {
+            if (errno == EINTR) continue;
+            return false;
+        }
+        data += written;
+        len -= written;
+    }
+    return true;
+}
+
+// Live entries in LRU order while replaying: front is coldest.
+struct ReplayIndex {
+    std::list<IndexRecord> order;
+    std::unordered_map<std::string, std::list<IndexRecord>::iterator> by_key;
+    size_t applied = 0;
+
+    void add(IndexRecord record) {
+        remove(record.key);
+        order.push_back(std::move(record));
+        by_key[order.back().key] = std::prev(order.end());
+    }
+
+    void remove(const std::string& key) {
+        auto it = by_key.find(key);
+        if (it == by_key.end()) return;
+        order.erase(it->second);
+        by_key.erase(it);
+    }
+};
+
+// Applies records from a mapped region. Returns the length of the valid
+// prefix; anything after it is a torn or corrupt tail.
+size_t replay(const char* data, size_t len, ReplayIndex& index) {
+    size_t pos = 0;
+    while (pos + sizeof(RecordHeader) <= len) {
+        RecordHeader header;
+        std::memcpy(&header, data + pos, sizeof(header));
+        size_t record_len = sizeof(header) + padded(header.key_len);
+        if (pos + record_len > len) break;
+
+        const char* key = data + pos + sizeof(header);
+        if (record_checksum(header, key) != header.checksum) break;
+
+        if (header.type == Add) {
+            std::optional<uint32_t> crc32c;
+            if (header.flags & HasCrc32c) crc32c = header.crc32c;
+            index.add(IndexRecord{std::string(key, header.key_len), header.size, header.disk_size, header.generation,
+                                  crc32c});
+        } else if (header.type == Remove) {
+            index.remove(std::string(key, header.key_len));
+        } else {
+            break;
+        }
+        ++index.applied;
+        pos += record_len;
+    }
+    return pos;
+}
+
+// Maps a file read-only and hands it to fn. Missing or empty files are
+// passed as an empty region.
+template <typename Fn>
+void with_mapped_file(const std::string& path, Fn fn) {
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+        fn(nullptr, 0);
+        return;
+    }
+    struct stat st;
+    if (::fstat(fd, &st) != 0 || st.st_size == 0) {
+        ::close(fd);
+        fn(nullptr, 0);
+        return;
+    }
+    void* data = ::mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    ::close(fd);
+    if (data == MAP_FAILED) {
+        LOG(ERROR) << "[INDEX] Failed to map " << path << "\n";
+        fn(nullptr, 0);
+        return;
+    }
+    ::madvise(data, st.st_size, MADV_SEQUENTIAL);
+    fn(static_cast<const char*>(data), static_cast<size_t>(st.st_size));
+    ::munmap(data, st.st_size);
+}
+
+}  // namespace
+
+IndexJournal::IndexJournal(const std::string& cache_dir)
+    : snapshot_path_(cache_dir + "/.index.snapshot"),
+      journal_path_(cache_dir + "/.index.journal"),
+      old_journal_path_(cache_dir + "/.index.journal.old"),
+      journal_fd_(-1), pending_records_(0) {
+    std::filesystem::create_directories(cache_dir);
+    open_journal();
+}
+
+IndexJournal::~IndexJournal() {
+    if (journal_fd_ >= 0) ::close(journal_fd_);
+}
+
+void IndexJournal::open_journal() {
+    journal_fd_ = ::open(journal_path_.c_str(), O_WRONLY | O_CREAT | O_APPEND, 0644);
+    if (journal_fd_ < 0) {
+        LOG(ERROR) << "[INDEX] Failed to open journal " << journal_path_ << ", index will not persist\n";
+    }
+}
+
+std::vector<IndexRecord> IndexJournal::load() {
+    ReplayIndex index;
+
+    with_mapped_file(snapshot_path_, [&](const char* data, size_t len) {
+        if (len < sizeof(SnapshotHeader)) return;
+        if (std::memcmp(data, SnapshotMagic, sizeof(SnapshotMagic)) != 0) {
+            LOG(WARNING) << "[INDEX] Ignoring snapshot with unknown format: " << snapshot_path_ << "\n";
+            return;
+        }
+        index.by_key.reserve(reinterpret_cast<const SnapshotHeader*>(data)->count);
+        replay(data + sizeof(SnapshotHeader), len - sizeof(SnapshotHeader), index);
+    });
+
+    // A journal.old is left behind when a compaction did not finish
+    bool interrupted_compaction = std::filesystem::exists(old_journal_path_);
+    with_mapped_file(old_journal_path_, [&](const char* data, size_t len) {
+        replay(data, len, index);
+    });
+
+    size_t applied_before_journal = index.applied;
+    with_mapped_file(journal_path_, [&](const char* data, size_t len) {
+        size_t valid = replay(data, len, index);
+        if (valid < len && journal_fd_ >= 0) {
+            LOG(WARNING) << "[INDEX] Dropping " << len - valid << " bytes of torn journal tail\n";
+            if (::ftruncate(journal_fd_, valid) != 0) {
+                LOG(ERROR) << "[INDEX] Failed to truncate journal " << journal_path_ << "\n";
+            }
+        }
+    });
+
+    pending_records_ = index.applied - applied_before_journal;
+
+    std::vector<IndexRecord> records(std::make_move_iterator(index.order.begin()),
+                                     std::make_move_iterator(index.order.end()));
+    LOG(INFO) << "[INDEX] Loaded " << records.size() << " entries\n";
+
+    if (interrupted_compaction) {
+        write_snapshot(records);
+    }
+    return records;
+}
+
+void IndexJournal::record_add(const IndexRecord& record) {
+    append(Add, record);
+}
+
+void IndexJournal::record_remove(const std::string& key) {
+    append(Remove, IndexRecord{key, 0, 0, 0, std::nullopt});
+}
+
+void IndexJournal::append(uint32_t type, const IndexRecord& record) {
+    std::string buffer;
+    encode_record(buffer, type, record);
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (journal_fd_ < 0) return;
+    // O_APPEND keeps every record contiguous; no fsync, since startup
+    // reconciles the index against cache_dir anyway
+    if (!write_all(journal_fd_, buffer.data(), buffer.size())) {
+        LOG(ERROR) << "[INDEX] Failed to append to journal " << journal_path_ << "\n";
+        return;
+    }
+    ++pending_records_;
+}
+
+size_t IndexJournal::pending_records() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return pending_records_;
+}
+
+void IndexJournal::rotate() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    // If an earlier compaction failed, its journal.old must survive until a
+    // snapshot lands; keep appending to the current journal instead
+    if (std::filesystem::exists(old_journal_path_)) return;
+
+    if (journal_fd_ >= 0) ::close(journal_fd_);
+    if (::rename(journal_path_.c_str(), old_journal_path_.c_str()) != 0) {
+        LOG(ERROR) << "[INDEX] Failed to rotate journal " << journal_path_ << "\n";
+    }
+    open_journal();
+    pending_records_ = 0;
+}
+
+void IndexJournal::write_snapshot(const std::vector<IndexRecord>& records) {
+    std::string temp_path = snapshot_path_ + ".tmp";
+    int fd = ::open(temp_path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) {
+        LOG(ERROR) << "[INDEX] Failed to create snapshot " << temp_path << "\n";
+        return;
+    }
+
+    SnapshotHeader header{};
+    std::memcpy(header.magic, SnapshotMagic, sizeof(SnapshotMagic));
+    header.count = records.size();
+    std::string buffer(reinterpret_cast<const char*>(&header), sizeof(header));
+
+    bool ok = true;
+    for (const auto& record : records) {
+        encode_record(buffer, Add, record);
+        if (buffer.size() >= (1 << 20)) {
+            ok = ok && write_all(fd, buffer.data(), buffer.size());
+            buffer.clear();
+        }
+    }
+    ok = ok && write_all(fd, buffer.data(), buffer.size());
+    ok = ok && ::fsync(fd) == 0;
+    ::close(fd);
+
+    if (!ok || ::rename(temp_path.c_str(), snapshot_path_.c_str()) != 0) {
+        LOG(ERROR) << "[INDEX] Failed to write snapshot " << snapshot_path_ << "\n";
+        ::unlink(temp_path.c_str());
+        return;
+    }
+
+    // Make the rename durable before the journal it replaces goes away
+    std::string dir = std::filesystem::path(snapshot_path_).parent_path().string();
+    int dir_fd = ::open(dir.c_str(), O_RDONLY | O_DIRECTORY);
+    if (dir_fd >= 0) {
+        ::fsync(dir_fd);
+        ::close(dir_fd);
+    }
+    ::unlink(old_journal_path_.c_str());
+    LOG(INFO) << "[INDEX] Wrote snapshot with " << records.size() << " entries\n";
+}
@@ -0,0 +1,55 @@
+#pragma once
+#include <cstdint>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <vector>
+
+struct IndexRecord {
+    std::string key;
+    uint64_t size;
+    uint64_t disk_size;                 // of its file in cache_dir; less than size if compressed
+    int64_t generation;
+    std::optional<uint32_t> crc32c;     // of the cached bytes, if known
+};
+
+// Persists the cache index in cache_dir as a snapshot plus an append-only
+// journal of adds and removes since that snapshot.
+//
+// Both files use the same 8-byte aligned record layout, so the snapshot is
+// read straight out of an mmap. Each record carries a checksum; replay stops
+// at the first torn or corrupt record, which is all a crash can leave behind
+// because records are only ever appended.
+class IndexJournal {
+public:
+    explicit IndexJournal(const std::string& cache_dir);
+    ~IndexJournal();
+
+    // Replays snapshot and journal. Returns the live entries, least recently
+    // used first. Must run before any other call.
+    std::vector<IndexRecord> load();
+
+    void record_add(const IndexRecord& record);
+    void record_remove(const std::string& key);
+
+    // Journal records appended since the last snapshot.
+    size_t pending_records() const;
+
+    // Compaction is two steps so callers can collect entries without holding
+    // the journal lock: rotate() starts a fresh journal, and write_snapshot()
+    // persists everything collected after the rotation and drops the old one.
+    void rotate();
+    void write_snapshot(const std::vector<IndexRecord>& records);
+
+private:
+    std::string snapshot_path_;
+    std::string journal_path_;
+    std::string old_journal_path_;
+
+    mutable std::mutex mutex_;
+    int journal_fd_;
+    size_t pending_records_;
+
+    void append(uint32_t type, const IndexRecord& record);
+    void open_journal();
+};
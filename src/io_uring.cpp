@@ -0,0 +1,166 @@
+#include "io_uring.h"
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <vector>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#if __has_include(<linux/io_uring.h>) && defined(__NR_io_uring_setup)
+#include <linux/io_uring.h>
+#define MORPH_HAVE_IO_URING 1
+#endif
+
+#ifdef MORPH_HAVE_IO_URING
+
+std::unique_ptr<IoUring> IoUring::create(unsigned entries) {
+    struct io_uring_params params;
+    std::memset(&params, 0, sizeof(params));
+    int ring_fd = static_cast<int>(::syscall(__NR_io_uring_setup, entries, &params));
+    if (ring_fd < 0) return nullptr;
+
+    std::unique_ptr<IoUring> ring(new IoUring());
+    ring->ring_fd_ = ring_fd;
+    ring->sq_ring_size_ = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    ring->cq_ring_size_ = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+    bool single_mmap = params.features & IORING_FEAT_SINGLE_MMAP;
+    if (single_mmap) {
+        ring->sq_ring_size_ = ring->cq_ring_size_ = std::max(ring->sq_ring_size_, ring->cq_ring_size_);
+    }
+
+    ring->sq_ring_ = ::mmap(nullptr, ring->sq_ring_size_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                            ring_fd, IORING_OFF_SQ_RING);
+    if (ring->sq_ring_ == MAP_FAILED) {
+        ring->sq_ring_ = nullptr;
+        return nullptr;
+    }
+    if (single_mmap) {
+        ring->cq_ring_ = ring->sq_ring_;
+    } else {
+        ring->cq_ring_ = ::mmap(nullptr, ring->cq_ring_size_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                                ring_fd, IORING_OFF_CQ_RING);
+        if (ring->cq_ring_ == MAP_FAILED) {
+            ring->cq_ring_ = nullptr;
+            return nullptr;
+        }
+    }
+    ring->sqes_size_ = params.sq_entries * sizeof(struct io_uring_sqe);
+    void* sqes = ::mmap(nullptr, ring->sqes_size_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                        ring_fd, IORING_OFF_SQES);
+    if (sqes == MAP_FAILED) return nullptr;
+    ring->sqes_ = static_cast<struct io_uring_sqe*>(sqes);
+
+    auto* sq = static_cast<char*>(ring->sq_ring_);
+    ring->sq_head_ = reinterpret_cast<unsigned*>(sq + params.sq_off.head);
+    ring->sq_tail_ = reinterpret_cast<unsigned*>(sq + params.sq_off.tail);
+    ring->sq_mask_ = reinterpret_cast<unsigned*>(sq + params.sq_off.ring_mask);
+    ring->sq_entries_ = reinterpret_cast<unsigned*>(sq + params.sq_off.ring_entries);
+    ring->sq_array_ = reinterpret_cast<unsigned*>(sq + params.sq_off.array);
+    auto* cq = static_cast<char*>(ring->cq_ring_);
+    ring->cq_head_ = reinterpret_cast<unsigned*>(cq + params.cq_off.head);
+    ring->cq_tail_ = reinterpret_cast<unsigned*>(cq + params.cq_off.tail);
+    ring->cq_mask_ = reinterpret_cast<unsigned*>(cq + params.cq_off.ring_mask);
+    ring->cqes_ = reinterpret_cast<struct io_uring_cqe*>(cq + params.cq_off.cqes);
+    return ring;
+}
+
+IoUring::~IoUring() {
+    if (sqes_) ::munmap(sqes_, sqes_size_);
+    if (cq_ring_ && cq_ring_ != sq_ring_) ::munmap(cq_ring_, cq_ring_size_);
+    if (sq_ring_) ::munmap(sq_ring_, sq_ring_size_);
+    if (ring_fd_ >= 0) ::close(ring_fd_);
+}
+
+bool IoUring::supports_writes() const {
+    constexpr unsigned ops = 256;
+    // uint64_t for the struct's alignment
+    std::vector<uint64_t> space((sizeof(struct io_uring_probe) + ops * sizeof(struct io_uring_probe_op)) /
+                                sizeof(uint64_t) + 1);
+    auto* probe = reinterpret_cast<struct io_uring_probe*>(space.data());
+    if (::syscall(__NR_io_uring_register, ring_fd_, IORING_REGISTER_PROBE, probe, ops) != 0) return false;
+    for (int op : {IORING_OP_WRITE, IORING_OP_WRITE_FIXED}) {
+        if (op > probe->last_op || !(probe->ops[op].flags & IO_URING_OP_SUPPORTED)) return false;
+    }
+    return true;
+}
+
+bool IoUring::register_buffers(const struct iovec* buffers, unsigned count) {
+    return ::syscall(__NR_io_uring_register, ring_fd_, IORING_REGISTER_BUFFERS, buffers, count) == 0;
+}
+
+bool IoUring::queue_write(int fd, const char* data, size_t len, uint64_t offset, int buffer_index,
+                          uint64_t user_data) {
+    // The tail is ours; the kernel moves the head as it consumes entries
+    unsigned tail = *sq_tail_;
+    if (tail - __atomic_load_n(sq_head_, __ATOMIC_ACQUIRE) >= *sq_entries_) return false;
+
+    unsigned index = tail & *sq_mask_;
+    struct io_uring_sqe* sqe = &sqes_[index];
+    std::memset(sqe, 0, sizeof(*sqe));
+    sqe->opcode = buffer_index >= 0 ? IORING_OP_WRITE_FIXED : IORING_OP_WRITE;
+    sqe->fd = fd;
+    sqe->off = offset;
+    sqe->addr = reinterpret_cast<uint64_t>(data);
+    sqe->len = static_cast<uint32_t>(len);
+    sqe->buf_index = buffer_index >= 0 ? static_cast<uint16_t>(buffer_index) : 0;
+    sqe->user_data = user_data;
+    sq_array_[index] = index;
+    __atomic_store_n(sq_tail_, tail + 1, __ATOMIC_RELEASE);
+    ++pending_;
+    return true;
+}
+
+bool IoUring::submit(unsigned min_complete) {
+    while (true) {
+        long submitted = ::syscall(__NR_io_uring_enter, ring_fd_, pending_, min_complete,
+                                   min_complete ? IORING_ENTER_GETEVENTS : 0, nullptr, 0);
+        if (submitted >= 0) {
+            pending_ -= static_cast<unsigned>(submitted);
+            return true;
+        }
+        if (errno != EINTR) return false;
+    }
+}
+
+bool IoUring::next_completion(uint64_t& user_data, int& result) {
+    // The head is ours; the kernel moves the tail as writes complete
+    unsigned head = *cq_head_;
+    if (head == __atomic_load_n(cq_tail_, __ATOMIC_ACQUIRE)) return false;
+    const struct io_uring_cqe& cqe = cqes_[head & *cq_mask_];
+    user_data = cqe.user_data;
+    result = cqe.res;
+    __atomic_store_n(cq_head_, head + 1, __ATOMIC_RELEASE);
+    return true;
+}
+
+#else
+
+std::unique_ptr<IoUring> IoUring::create(unsigned) {
+    return nullptr;
+}
+
+IoUring::~IoUring() = default;
+
+bool IoUring::supports_writes() const {
+    return false;
+}
+
+bool IoUring::register_buffers(const struct iovec*, unsigned) {
+    return false;
+}
+
+bool IoUring::queue_write(int, const char*, size_t, uint64_t, int, uint64_t) {
+    return false;
+}
+
+bool IoUring::submit(unsigned) {
+    errno = ENOSYS;
+    return false;
+}
+
+bool IoUring::next_completion(uint64_t&, int&) {
+    return false;
+}
+
+#endif
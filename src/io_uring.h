@@ -0,0 +1,59 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <sys/uio.h>
+
+// Minimal io_uring submission/completion ring over the raw syscalls, for
+// one thread at a time. Only what file writes need: queue writes, submit
+// them in one call, and reap completions.
+class IoUring {
+public:
+    // nullptr where the kernel, or a seccomp policy, does not allow io_uring
+    static std::unique_ptr<IoUring> create(unsigned entries);
+    ~IoUring();
+
+    IoUring(const IoUring&) = delete;
+    IoUring& operator=(const IoUring&) = delete;
+
+    // Whether the kernel has the write opcodes. Rings can be set up from
+    // 5.1, but IORING_OP_WRITE only came in 5.6, with the probe this asks.
+    bool supports_writes() const;
+
+    // Pins buffers for IORING_OP_WRITE_FIXED. False if the kernel refused,
+    // e.g. over RLIMIT_MEMLOCK; plain writes still work then.
+    bool register_buffers(const struct iovec* buffers, unsigned count);
+
+    // Queues a write, from registered buffer buffer_index or, with -1, from
+    // any memory. Returns false if the submission queue is full.
+    bool queue_write(int fd, const char* data, size_t len, uint64_t offset, int buffer_index, uint64_t user_data);
+    // Submits everything queued and waits until min_complete completions
+    // are ready. Returns false on error, with errno set.
+    bool submit(unsigned min_complete);
+    // Pops one completion, if one is ready. result is the write's return
+    // value, or -errno.
+    bool next_completion(uint64_t& user_data, int& result);
+
+private:
+    IoUring() = default;
+
+    int ring_fd_ = -1;
+    unsigned pending_ = 0;
+
+    void* sq_ring_ = nullptr;
+    size_t sq_ring_size_ = 0;
+    void* cq_ring_ = nullptr;
+    size_t cq_ring_size_ = 0;
+    struct io_uring_sqe* sqes_ = nullptr;
+    size_t sqes_size_ = 0;
+
+    unsigned* sq_head_ = nullptr;
+    unsigned* sq_tail_ = nullptr;
+    unsigned* sq_mask_ = nullptr;
+    unsigned* sq_entries_ = nullptr;
+    unsigned* sq_array_ = nullptr;
+    unsigned* cq_head_ = nullptr;
+    unsigned* cq_tail_ = nullptr;
+    unsigned* cq_mask_ = nullptr;
+    struct io_uring_cqe* cqes_ = nullptr;
+};
@@ -0,0 +1,111 @@
+#include "manifest_prefetcher.h"
+#include <algorithm>
+#include <glog/logging.h>
+#include "constants.h"
+
+ManifestPrefetcher::ManifestPrefetcher(ObjectFn fetch, ObjectFn consumed, size_t window)
+    : fetch_(std::move(fetch)), consumed_(std::move(consumed)), window_(window) {
+    for (size_t i = 0; i < Constants::ManifestPrefetchWorkers; ++i) {
+        workers_.emplace_back(&ManifestPrefetcher::run_worker, this);
+    }
+}
+
+ManifestPrefetcher::~ManifestPrefetcher() {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stopping_ = true;
+    }
+    cond_.notify_all();
+    for (auto& worker : workers_) worker.join();
+}
+
+void ManifestPrefetcher::register_manifest(const std::string& client_id, ObjectList objects) {
+    LOG(INFO) << "[MANIFEST] client_id=" << client_id << " registered " << objects.size() << " objects\n";
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (objects.empty()) {
+            manifests_.erase(client_id);
+            return;
+        }
+        Manifest& manifest = manifests_[client_id];
+        manifest = Manifest{};
+        manifest.objects = std::move(objects);
+        for (size_t i = 0; i < manifest.objects.size(); ++i) {
+            const auto& [bucket, file] = manifest.objects[i];
+            manifest.index.emplace(bucket + "/" + file, i);
+        }
+        schedule_locked(manifest, 0);
+    }
+    cond_.notify_all();
+}
+
+void ManifestPrefetcher::on_object_read(const std::string& client_id, const std::string& bucket,
+                                        const std::string& file) {
+    std::vector<std::pair<std::string, std::string>> consumed;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto it = manifests_.find(client_id);
+        if (it == manifests_.end()) return;
+        Manifest& manifest = it->second;
+        auto pos = manifest.index.find(bucket + "/" + file);
+        if (pos == manifest.index.end()) return;
+
+        size_t size = manifest.objects.size();
+        size_t position = manifest.last_read - manifest.last_read % size + pos->second;
+        if (manifest.started) {
+            // Reads before the last one start the next epoch
+            if (position < manifest.last_read) position += size;
+            if (position == manifest.last_read) return;
+            // The last object read, and any the client skipped, are done
+            // with; a manifest that fits in the window stays cached whole
+            size_t from = std::max(manifest.last_read, position - std::min(position, size));
+            for (size_t p = from; p < position && size > window_; ++p) {
+                consumed.push_back(manifest.objects[p % size]);
+            }
+        }
+        manifest.started = true;
+        manifest.last_read = position;
+        schedule_locked(manifest, position + 1);
+    }
+    cond_.notify_all();
+
+    for (const auto& [consumed_bucket, consumed_file] : consumed) consumed_(consumed_bucket, consumed_file);
+}
+
+std::optional<ManifestProgress> ManifestPrefetcher::progress(const std::string& client_id) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto it = manifests_.find(client_id);
+    if (it == manifests_.end()) return std::nullopt;
+    const Manifest& manifest = it->second;
+    size_t size = manifest.objects.size();
+    return ManifestProgress{size, manifest.last_read % size, manifest.last_read / size};
+}
+
+// Queues the objects of the window starting at from that are not queued yet
+void ManifestPrefetcher::schedule_locked(Manifest& manifest, size_t from) {
+    size_t until = from + std::min(window_, manifest.objects.size());
+    for (size_t p = std::max(from, manifest.scheduled_until); p < until; ++p) {
+        queue_.push_back(manifest.objects[p % manifest.objects.size()]);
+    }
+    manifest.scheduled_until = std::max(manifest.scheduled_until, until);
+}
+
+void ManifestPrefetcher::run_worker() {
+    while (true) {
+        std::pair<std::string, std::string> object;
+        {
+            std::unique_lock<std::mutex> lock(mutex_);
+            cond_.wait(lock, [&] { return stopping_ || !queue_.empty(); });
+            if (stopping_) return;
+            object = std::move(queue_.front());
+            queue_.pop_front();
+        }
+
+        try {
+            fetch_(object.first, object.second);
+        } catch (const std::exception& e) {
+            LOG(WARNING) << "[MANIFEST] Prefetch of " << object.first << "/" << object.second
+                         << " failed: " << e.what() << "\n";
+        }
+    }
+}
@@ -0,0 +1,69 @@
+#pragma once
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+struct ManifestProgress {
+    size_t length;
+    size_t position;    // index of the object read last
+    size_t epoch;       // times the client wrapped around to the start
+};
+
+// Just-in-time prefetch for clients that read a known, ordered list of
+// objects every epoch. Each client registers its manifest; its /object
+// requests move its position, the next window objects (wrapping into the
+// next epoch) are fetched ahead of it, and objects it has moved past are
+// handed back to be evicted first. The cache holds roughly one window per
+// client instead of the whole working set.
+class ManifestPrefetcher {
+public:
+    using ObjectList = std::vector<std::pair<std::string, std::string>>;    // bucket, file
+    using ObjectFn = std::function<void(const std::string& bucket, const std::string& file)>;
+
+    // fetch fills one object and returns once it is cached; consumed marks
+    // one for early eviction.
+    ManifestPrefetcher(ObjectFn fetch, ObjectFn consumed, size_t window);
+    ~ManifestPrefetcher();
+
+    ManifestPrefetcher(const ManifestPrefetcher&) = delete;
+    ManifestPrefetcher& operator=(const ManifestPrefetcher&) = delete;
+
+    // Replaces the client's manifest; an empty one unregisters it. The
+    // first window is fetched right away.
+    void register_manifest(const std::string& client_id, ObjectList objects);
+
+    void on_object_read(const std::string& client_id, const std::string& bucket, const std::string& file);
+
+    std::optional<ManifestProgress> progress(const std::string& client_id);
+
+private:
+    struct Manifest {
+        ObjectList objects;
+        std::unordered_map<std::string, size_t> index;  // bucket/file -> first position
+        // Positions count on across epochs; position % size is the object
+        bool started = false;
+        size_t last_read = 0;
+        size_t scheduled_until = 0;     // fetches queued below this
+    };
+
+    ObjectFn fetch_;
+    ObjectFn consumed_;
+    const size_t window_;
+
+    std::mutex mutex_;
+    std::condition_variable cond_;
+    std::unordered_map<std::string, Manifest> manifests_;
+    std::deque<std::pair<std::string, std::string>> queue_;
+    bool stopping_ = false;
+    std::vector<std::thread> workers_;
+
+    void schedule_locked(Manifest& manifest, size_t from);
+    void run_worker();
+};
@@ -0,0 +1,44 @@
+#include "metadata_cache.h"
+#include <algorithm>
+
+MetadataCache::MetadataCache(size_t max_entries)
+    : max_entries_(std::max<size_t>(max_entries, 1)) {}
+
+std::optional<ObjectMetadata> MetadataCache::get(const std::string& key) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto it = entries_.find(key);
+    if (it == entries_.end()) return std::nullopt;
+    if (std::chrono::steady_clock::now() >= it->second.fresh_until) {
+        lru_.erase(it->second.lru_pos);
+        entries_.erase(it);
+        return std::nullopt;
+    }
+    lru_.splice(lru_.begin(), lru_, it->second.lru_pos);
+    return it->second.metadata;
+}
+
+void MetadataCache::put(const std::string& key, const ObjectMetadata& metadata,
+                        std::chrono::steady_clock::time_point fresh_until) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto it = entries_.find(key);
+    if (it != entries_.end()) {
+        it->second.metadata = metadata;
+        it->second.fresh_until = fresh_until;
+        lru_.splice(lru_.begin(), lru_, it->second.lru_pos);
+        return;
+    }
+    lru_.push_front(key);
+    entries_.emplace(key, Entry{metadata, fresh_until, lru_.begin()});
+    while (entries_.size() > max_entries_) {
+        entries_.erase(lru_.back());
+        lru_.pop_back();
+    }
+}
+
+void MetadataCache::erase(const std::string& key) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto it = entries_.find(key);
+    if (it == entries_.end()) return;
+    lru_.erase(it->second.lru_pos);
+    entries_.erase(it);
+}
@@ -0,0 +1,44 @@
+#pragma once
+#include <chrono>
+#include <cstdint>
+#include <list>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <unordered_map>
+
+struct ObjectMetadata {
+    uint64_t size = 0;
+    int64_t generation = 0;
+    int64_t metageneration = 0;
+    std::optional<uint32_t> crc32c;
+    std::string content_type;
+    std::chrono::system_clock::time_point updated;
+};
+
+// Object metadata from GCS, kept apart from the data cache so a size or
+// generation lookup needs neither a cached copy of the object nor a round
+// trip. Each entry is served until its deadline; past max_entries the
+// least recently used go.
+class MetadataCache {
+public:
+    explicit MetadataCache(size_t max_entries);
+
+    // The entry for key if it is still fresh
+    std::optional<ObjectMetadata> get(const std::string& key);
+    void put(const std::string& key, const ObjectMetadata& metadata,
+             std::chrono::steady_clock::time_point fresh_until);
+    void erase(const std::string& key);
+
+private:
+    struct Entry {
+        ObjectMetadata metadata;
+        std::chrono::steady_clock::time_point fresh_until;
+        std::list<std::string>::iterator lru_pos;
+    };
+
+    const size_t max_entries_;
+    std::mutex mutex_;
+    std::unordered_map<std::string, Entry> entries_;
+    std::list<std::string> lru_;    // most recently used first
+};
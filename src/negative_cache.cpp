@@ -0,0 +1,140 @@
+#include "negative_cache.h"
+#include <algorithm>
+#include <functional>
+#include "constants.h"
+
+namespace {
+
+size_t next_power_of_two(size_t n) {
+    size_t power = 1;
+    while (power < n) power <<= 1;
+    return power;
+}
+
+}  // namespace
+
+NegativeCache::NegativeCache(size_t max_entries, size_t ttl_sec)
+    : max_entries_(std::max<size_t>(max_entries, 1)), ttl_(ttl_sec) {
+    // About 1% false positives at max_entries
+    size_t bits = next_power_of_two(std::max<size_t>(max_entries_ * Constants::NegativeBloomBitsPerKey, 64));
+    bloom_ = std::make_unique<std::atomic<uint64_t>[]>(bits / 64);
+    for (size_t i = 0; i < bits / 64; ++i) bloom_[i] = 0;
+    bloom_mask_ = bits - 1;
+}
+
+void NegativeCache::insert(const std::string& key) {
+    if (!enabled()) return;
+    auto now = Clock::now();
+    std::lock_guard<std::mutex> lock(mutex_);
+    drop_expired_locked(now);
+
+    auto deadline = now + ttl_;
+    expiry_[key] = deadline;
+    order_.emplace_back(key, deadline);
+    bloom_add(key);
+
+    // Re-inserted keys leave their older place in order_ behind, so it is
+    // bounded too
+    size_t dropped = 0;
+    while (expiry_.size() > max_entries_ || order_.size() > 2 * max_entries_) {
+        auto& [oldest, oldest_deadline] = order_.front();
+        auto it = expiry_.find(oldest);
+        if (it != expiry_.end() && it->second == oldest_deadline) {
+            expiry_.erase(it);
+            ++dropped;
+        }
+        order_.pop_front();
+    }
+    removed_locked(dropped);
+}
+
+bool NegativeCache::contains(const std::string& key) {
+    if (!enabled() || !may_contain(key)) return false;
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto it = expiry_.find(key);
+    if (it == expiry_.end()) return false;
+    if (Clock::now() < it->second) return true;
+    expiry_.erase(it);
+    removed_locked(1);
+    return false;
+}
+
+size_t NegativeCache::erase(const std::string& key) {
+    if (!enabled() || !may_contain(key)) return 0;
+    std::lock_guard<std::mutex> lock(mutex_);
+    size_t erased = expiry_.erase(key);
+    removed_locked(erased);
+    return erased;
+}
+
+size_t NegativeCache::erase_prefix(const std::string& prefix) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    size_t erased = 0;
+    for (auto it = expiry_.begin(); it != expiry_.end();) {
+        if (it->first.compare(0, prefix.size(), prefix) == 0) {
+            it = expiry_.erase(it);
+            ++erased;
+        } else {
+            ++it;
+        }
+    }
+    if (expiry_.empty()) order_.clear();
+    removed_locked(erased);
+    return erased;
+}
+
+void NegativeCache::drop_expired_locked(Clock::time_point now) {
+    size_t dropped = 0;
+    while (!order_.empty() && order_.front().second <= now) {
+        auto it = expiry_.find(order_.front().first);
+        if (it != expiry_.end() && it->second == order_.front().second) {
+            expiry_.erase(it);
+            ++dropped;
+        }
+        order_.pop_front();
+    }
+    removed_locked(dropped);
+}
+
+// Removed keys keep their bits set; once enough have piled up the filter is
+// rebuilt from what is left. A lookup racing the rebuild may miss a key and
+// ask GCS once more.
+void NegativeCache::removed_locked(size_t count) {
+    removed_since_rebuild_ += count;
+    if (removed_since_rebuild_ < max_entries_) return;
+    removed_since_rebuild_ = 0;
+    for (size_t i = 0; i <= bloom_mask_ / 64; ++i) bloom_[i].store(0, std::memory_order_relaxed);
+    for (const auto& [key, deadline] : expiry_) bloom_add(key);
+}
+
+uint64_t NegativeCache::hash(const std::string& key) {
+    // splitmix64 finalizer over std::hash, which may be the identity-ish
+    uint64_t h = std::hash<std::string>{}(key);
+    h = (h ^ (h >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    h = (h ^ (h >> 27)) * 0x94d049bb133111ebULL;
+    return h ^ (h >> 31);
+}
+
+size_t NegativeCache::bit_index(uint64_t hash, int i) const {
+    // Double hashing: probe i is h1 + i * h2
+    uint64_t h1 = hash & 0xffffffff;
+    uint64_t h2 = (hash >> 32) | 1;
+    return (h1 + i * h2) & bloom_mask_;
+}
+
+bool NegativeCache::may_contain(const std::string& key) const {
+    uint64_t h = hash(key);
+    for (int i = 0; i < Hashes; ++i) {
+        size_t bit = bit_index(h, i);
+        if (!(bloom_[bit >> 6].load(std::memory_order_relaxed) & (uint64_t(1) << (bit & 63)))) return false;
+    }
+    return true;
+}
+
+void NegativeCache::bloom_add(const std::string& key) {
+    uint64_t h = hash(key);
+    for (int i = 0; i < Hashes; ++i) {
+        size_t bit = bit_index(h, i);
+        bloom_[bit >> 6].fetch_or(uint64_t(1) << (bit & 63), std::memory_order_relaxed);
+    }
+}
@@ -0,0 +1,55 @@
+#pragma once
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <utility>
+
+// Objects GCS recently said do not exist, remembered for ttl so clients
+// polling for an object that is not written yet are answered locally. A
+// Bloom filter in front keeps the lookup lock-free for the usual case of an
+// object that was never missing. At most max_entries are kept; the oldest
+// go first.
+class NegativeCache {
+public:
+    // A ttl of 0 disables the cache.
+    NegativeCache(size_t max_entries, size_t ttl_sec);
+
+    bool enabled() const { return ttl_.count() > 0; }
+
+    void insert(const std::string& key);
+    bool contains(const std::string& key);
+    // Returns 1 if the key was there, else 0
+    size_t erase(const std::string& key);
+    // Erases the keys starting with prefix, all of them for an empty one.
+    // Returns how many went.
+    size_t erase_prefix(const std::string& prefix);
+
+private:
+    using Clock = std::chrono::steady_clock;
+    static constexpr int Hashes = 7;
+
+    const size_t max_entries_;
+    const std::chrono::seconds ttl_;
+
+    // Bits are only set between rebuilds, so a key removed from the map
+    // costs a lookup until the next rebuild, never a wrong answer
+    std::unique_ptr<std::atomic<uint64_t>[]> bloom_;
+    size_t bloom_mask_;
+
+    std::mutex mutex_;
+    std::unordered_map<std::string, Clock::time_point> expiry_;
+    std::deque<std::pair<std::string, Clock::time_point>> order_;  // insertion order, so also expiry order
+    size_t removed_since_rebuild_ = 0;
+
+    static uint64_t hash(const std::string& key);
+    size_t bit_index(uint64_t hash, int i) const;
+    bool may_contain(const std::string& key) const;
+    void bloom_add(const std::string& key);
+    void drop_expired_locked(Clock::time_point now);
+    void removed_locked(size_t count);
+};
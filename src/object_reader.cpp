@@ -0,0 +1,177 @@
+#include "object_reader.h"
+#include "gcs_cache.h"
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <algorithm>
+#include <stdexcept>
+
+ObjectReader::ObjectReader(int fd, std::shared_ptr<InFlightFill> fill)
+    : fd_(fd), fill_(std::move(fill)), offset_(0) {
+    if (fill_) {
+        // Set before the fill is marked started and never changed after, and
+        // join_fill constructs readers while holding fill->mutex
+        size_ = fill_->object_size;
+    } else {
+        struct stat st;
+        if (::fstat(fd_, &st) == 0) size_ = st.st_size;
+        // Served front to back, so let the kernel read further ahead
+        ::posix_fadvise(fd_, 0, 0, POSIX_FADV_SEQUENTIAL);
+    }
+}
+
+ObjectReader::ObjectReader(std::shared_ptr<const std::string> data)
+    : fd_(-1), data_(std::move(data)), offset_(0) {
+    size_ = data_->size();
+}
+
+ObjectReader::ObjectReader(std::shared_ptr<std::istream> upstream, size_t size)
+    : fd_(-1), upstream_(std::move(upstream)), offset_(0), size_(size) {}
+
+ObjectReader::ObjectReader(RangeOpener open_range, size_t size)
+    : fd_(-1), open_range_(std::move(open_range)), range_end_(size), offset_(0), size_(size) {}
+
+ObjectReader::ObjectReader(BlockOpener open_block, size_t size, size_t block_size)
+    : fd_(-1), offset_(0), size_(size), open_block_(std::move(open_block)) {
+    for (uint64_t end = block_size; end - block_size < size; end += block_size) {
+        part_ends_.push_back(std::min<uint64_t>(end, size));
+    }
+}
+
+ObjectReader::ObjectReader(BlockOpener open_block, std::vector<uint64_t> part_ends)
+    : fd_(-1), offset_(0), size_(part_ends.empty() ? 0 : part_ends.back()), open_block_(std::move(open_block)),
+      part_ends_(std::move(part_ends)) {}
+
+ObjectReader::~ObjectReader() {
+    if (fd_ >= 0) ::close(fd_);
+}
+
+size_t ObjectReader::read(char* buffer, size_t len) {
+    if (open_block_) {
+        while (block_index_ < part_ends_.size()) {
+            if (!block_) {
+                block_ = open_block_(block_index_);
+                size_t within = offset_ - (block_index_ ? part_ends_[block_index_ - 1] : 0);
+                if (within > 0) block_->seek(within);
+            }
+            size_t bytes_read = block_->read(buffer, len);
+            if (bytes_read > 0) {
+                offset_ += bytes_read;
+                return bytes_read;
+            }
+            block_.reset();
+            ++block_index_;
+        }
+        return 0;
+    }
+
+    if (data_) {
+        if (offset_ >= data_->size()) return 0;
+        len = std::min(len, data_->size() - offset_);
+        data_->copy(buffer, len, offset_);
+        offset_ += len;
+        return len;
+    }
+
+    if (open_range_ && !upstream_) {
+        if (offset_ >= range_end_) return 0;
+        upstream_ = open_range_(offset_, range_end_);
+    }
+
+    if (upstream_) {
+        upstream_->read(buffer, len);
+        if (upstream_->bad()) {
+            throw std::runtime_error("Upstream read failed");
+        }
+        offset_ += upstream_->gcount();
+        return upstream_->gcount();
+    }
+
+    if (fill_) {
+        len = std::min(len, wait_for_bytes());
+        if (len == 0) return 0;
+    }
+
+    ssize_t bytes_read = ::pread(fd_, buffer, len, offset_);
+    if (bytes_read < 0) {
+        throw std::runtime_error("Failed to read cached object");
+    }
+    offset_ += bytes_read;
+    return bytes_read;
+}
+
+size_t ObjectReader::send(size_t len, const FileSender& send_file) {
+    if (open_block_) {
+        while (block_index_ < part_ends_.size()) {
+            if (!block_) {
+                block_ = open_block_(block_index_);
+                size_t within = offset_ - (block_index_ ? part_ends_[block_index_ - 1] : 0);
+                if (within > 0) block_->seek(within);
+            }
+            size_t sent = block_->send(len, send_file);
+            if (sent > 0) {
+                offset_ += sent;
+                return sent;
+            }
+            // Not in a file; read() takes it from here
+            if (block_->position() < block_->size()) return 0;
+            block_.reset();
+            ++block_index_;
+        }
+        return 0;
+    }
+
+    if (fd_ < 0) return 0;
+    if (fill_) {
+        len = std::min(len, wait_for_bytes());
+    } else {
+        len = std::min(len, size_ - std::min(size_, offset_));
+    }
+    if (len == 0) return 0;
+    send_file(fd_, offset_, len);
+    offset_ += len;
+    return len;
+}
+
+void ObjectReader::seek(size_t offset, size_t end) {
+    if (open_block_) {
+        size_t index = std::upper_bound(part_ends_.begin(), part_ends_.end(), offset) - part_ends_.begin();
+        if (index != block_index_ || offset < offset_) block_.reset();
+        else if (block_) block_->seek(offset - (index ? part_ends_[index - 1] : 0));
+        block_index_ = index;
+        offset_ = offset;
+        return;
+    }
+
+    if (open_range_) {
+        // Drop the current read; the next one starts at the new offset
+        upstream_.reset();
+        range_end_ = end > offset ? std::min(end, size_) : size_;
+        offset_ = offset;
+        return;
+    }
+
+    if (upstream_) {
+        if (offset < offset_) {
+            throw std::runtime_error("Cannot seek backwards in an upstream stream");
+        }
+        upstream_->ignore(offset - offset_);
+        if (upstream_->bad()) {
+            throw std::runtime_error("Upstream read failed");
+        }
+    }
+    offset_ = offset;
+}
+
+// Returns how many bytes past offset_ the fill has written, 0 once it is done
+// and everything has been read.
+size_t ObjectReader::wait_for_bytes() {
+    std::unique_lock<std::mutex> lock(fill_->mutex);
+    fill_->cond.wait(lock, [&] {
+        return fill_->bytes_written > offset_ || fill_->done;
+    });
+    if (!fill_->error.empty()) {
+        throw std::runtime_error(fill_->error);
+    }
+    return fill_->bytes_written > offset_ ? fill_->bytes_written - offset_ : 0;
+}
@@ -0,0 +1,76 @@
+#pragma once
+#include <functional>
+#include <istream>
+#include <memory>
+#include <string>
+#include <vector>
+
+struct InFlightFill;
+
+// Reader over one object: a file on disk, a copy held by the RAM tier, or an
+// upstream stream for objects the cache declined to admit or ranges it does
+// not hold. When the object is still being filled, reads follow the growing
+// .tmp file and block at the fill's write offset until more bytes land or
+// the fill finishes.
+class ObjectReader {
+public:
+    ObjectReader(int fd, std::shared_ptr<InFlightFill> fill);
+    explicit ObjectReader(std::shared_ptr<const std::string> data);
+    ObjectReader(std::shared_ptr<std::istream> upstream, size_t size);
+
+    // Ranged upstream: each seek opens a new read from the given offset up
+    // to end (exclusive).
+    using RangeOpener = std::function<std::shared_ptr<std::istream>(size_t begin, size_t end)>;
+    ObjectReader(RangeOpener open_range, size_t size);
+
+    // Block mode: concatenates the blocks of an object, each opened on demand.
+    using BlockOpener = std::function<std::shared_ptr<ObjectReader>(size_t index)>;
+    ObjectReader(BlockOpener open_block, size_t size, size_t block_size);
+    // Same over parts of varying length; part_ends holds each one's end offset.
+    ObjectReader(BlockOpener open_block, std::vector<uint64_t> part_ends);
+    ~ObjectReader();
+
+    ObjectReader(const ObjectReader&) = delete;
+    ObjectReader& operator=(const ObjectReader&) = delete;
+
+    // Reads up to len bytes. Returns 0 at the end of the object, throws if
+    // the fill it follows fails.
+    size_t read(char* buffer, size_t len);
+
+    // Hands up to len bytes to send_file(fd, offset, len) when they sit in a
+    // file, so they can go out with sendfile() without being copied. Returns
+    // how many it handed over: 0 when the next bytes are not in a file (RAM
+    // tier, upstream), so read() them instead, or at the end of the object.
+    using FileSender = std::function<void(int fd, size_t offset, size_t len)>;
+    size_t send(size_t len, const FileSender& send_file);
+
+    // Moves the read position to offset. end, when given, is where the caller
+    // will stop reading, so an upstream read can ask for just that range. A
+    // plain upstream stream can only skip forward.
+    void seek(size_t offset, size_t end = 0);
+
+    size_t position() const { return offset_; }
+    size_t size() const { return size_; }
+
+    // Set when the bytes are the object as stored, compressed with this
+    // encoding, so they go out under a matching Content-Encoding
+    const std::string& content_encoding() const { return content_encoding_; }
+    void set_content_encoding(const std::string& encoding) { content_encoding_ = encoding; }
+
+private:
+    int fd_;
+    std::shared_ptr<InFlightFill> fill_;
+    std::shared_ptr<const std::string> data_;
+    std::shared_ptr<std::istream> upstream_;
+    RangeOpener open_range_;
+    size_t range_end_ = 0;
+    size_t offset_;
+    size_t size_ = 0;
+    BlockOpener open_block_;
+    std::vector<uint64_t> part_ends_;
+    size_t block_index_ = 0;
+    std::shared_ptr<ObjectReader> block_;
+    std::string content_encoding_;
+
+    size_t wait_for_bytes();
+};
@@ -0,0 +1,63 @@
+#include "ram_tier.h"
+
+RamTier::RamTier(RamTracker& ram_tracker, size_t capacity)
+    : ram_tracker_(ram_tracker), capacity_(capacity), size_bytes_(0) {}
+
+std::shared_ptr<const std::string> RamTier::get(const std::string& key, int64_t& generation) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto it = index_.find(key);
+    if (it == index_.end()) return nullptr;
+    lru_keys_.splice(lru_keys_.begin(), lru_keys_, it->second.lru_it);
+    generation = it->second.generation;
+    return it->second.data;
+}
+
+bool RamTier::insert(const std::string& key, std::shared_ptr<const std::string> data, int64_t generation) {
+    size_t size = data->size();
+    if (size > capacity_) return false;
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto existing = index_.find(key);
+    if (existing != index_.end() && existing->second.generation == generation) return true;
+    if (existing != index_.end()) erase_locked(key);
+
+    // Colder entries that must make room are only dropped once the rest of
+    // the memory is reserved; their reservations pass to the new entry
+    size_t victims = 0, demoted = 0;
+    for (auto it = lru_keys_.rbegin(); size_bytes_ - demoted + size > capacity_ && it != lru_keys_.rend(); ++it) {
+        demoted += index_.find(*it)->second.data->size();
+        ++victims;
+    }
+    if (size > demoted && !ram_tracker_.try_reserve(size - demoted)) return false;
+    for (; victims > 0; --victims) {
+        LOG(INFO) << "[RAM] DEMOTED: " << lru_keys_.back() << "\n";
+        remove_locked(lru_keys_.back());
+    }
+    if (demoted > size) ram_tracker_.release(demoted - size);
+
+    lru_keys_.push_front(key);
+    index_[key] = Entry{std::move(data), generation, lru_keys_.begin()};
+    size_bytes_ += size;
+    LOG(INFO) << "[RAM] PROMOTED: " << key << " (" << size << " bytes)\n";
+    return true;
+}
+
+void RamTier::erase(const std::string& key) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    erase_locked(key);
+}
+
+void RamTier::erase_locked(const std::string& key) {
+    ram_tracker_.release(remove_locked(key));
+}
+
+// Drops an entry but keeps its memory reserved. Returns its size.
+size_t RamTier::remove_locked(const std::string& key) {
+    auto it = index_.find(key);
+    if (it == index_.end()) return 0;
+    size_t size = it->second.data->size();
+    lru_keys_.erase(it->second.lru_it);
+    index_.erase(it);
+    size_bytes_ -= size;
+    return size;
+}
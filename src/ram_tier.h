@@ -0,0 +1,44 @@
+#pragma once
+#include "ram_tracker.h"
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+// Whole copies of small, hot objects kept in memory, each tagged with the
+// generation it was copied from. Every byte held here is
+// reserved from the RamTracker, so the tier and the stream buffers share the
+// max_ram budget. Entries are only ever copies of objects on disk: dropping
+// one is a demotion, not a loss.
+class RamTier {
+public:
+    RamTier(RamTracker& ram_tracker, size_t capacity);
+
+    // Sets generation to the copy's when there is one
+    std::shared_ptr<const std::string> get(const std::string& key, int64_t& generation);
+
+    // Evicts colder entries to make room. Returns false, evicting nothing,
+    // if the object cannot fit or the RamTracker has no memory to spare.
+    bool insert(const std::string& key, std::shared_ptr<const std::string> data, int64_t generation);
+
+    void erase(const std::string& key);
+
+private:
+    struct Entry {
+        std::shared_ptr<const std::string> data;
+        int64_t generation;
+        std::list<std::string>::iterator lru_it;
+    };
+
+    RamTracker& ram_tracker_;
+    const size_t capacity_;
+    size_t size_bytes_;
+
+    std::mutex mutex_;
+    std::unordered_map<std::string, Entry> index_;
+    std::list<std::string> lru_keys_;
+
+    void erase_locked(const std::string& key);
+    size_t remove_locked(const std::string& key);
+};
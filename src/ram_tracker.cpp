@@ -1,24 +1,247 @@
 #include "ram_tracker.h"
+#include <algorithm>
+#include "constants.h"
 
-RamTracker::RamTracker(size_t max_bytes)
-    : max_bytes_(max_bytes), used_bytes_(0) {}
+RamTracker::RamTracker(size_t max_bytes, const TenantBudget& budget)
+    : max_bytes_(max_bytes), budget_(budget), used_bytes_(0), queued_(0), handoff_(false), reclaim_wanted_(false),
+      waits_(0), wait_time_us_(0), timeouts_(0), last_idle_sweep_(std::chrono::steady_clock::now()) {}
+
+bool RamTracker::add_if_fits(size_t bytes) {
+    size_t used = used_bytes_.load();
+    while (used + bytes <= max_bytes_) {
+        if (used_bytes_.compare_exchange_weak(used, used + bytes)) return true;
+    }
+    return false;
+}
+
+bool RamTracker::try_reserve(size_t bytes) {
+    // Past the barging window, what is free belongs to whoever has been
+    // waiting longest
+    return may_barge() && add_if_fits(bytes);
+}
 
 void RamTracker::wait_and_reserve(size_t bytes) {
+    if (may_barge() && add_if_fits(bytes)) return;
+    Waiter waiter(bytes, nullptr, nullptr);
     std::unique_lock<std::mutex> lock(mutex_);
-    cond_.wait(lock, [&] {
-        return used_bytes_ + bytes <= max_bytes_;
-    });
-    used_bytes_ += bytes;
+    reserve_queued(waiter, lock, nullptr);
     // too verbose
     // LOG(INFO) << "Reserved " << bytes << " bytes, total in use: " << used_bytes_ << "\n";
 }
 
-void RamTracker::release(size_t bytes) {
+bool RamTracker::try_reserve_until(size_t bytes, std::chrono::steady_clock::time_point deadline) {
+    if (may_barge() && add_if_fits(bytes)) return true;
+    Waiter waiter(bytes, nullptr, nullptr);
+    std::unique_lock<std::mutex> lock(mutex_);
+    return reserve_queued(waiter, lock, &deadline);
+}
+
+bool RamTracker::try_reserve_until(size_t bytes, std::chrono::steady_clock::time_point deadline,
+                                   const Tenant& tenant, bool& borrowed) {
+    if (may_barge() && add_if_fits(bytes)) {
+        {
+            std::lock_guard<std::mutex> accounts(accounts_mutex_);
+            Waiter waiter(bytes, &clients_[tenant.client], &buckets_[tenant.bucket]);
+            if (within_caps(waiter)) {
+                charge(waiter);
+                borrowed = waiter.borrowed;
+                return true;
+            }
+        }
+        // Over the tenant's cap: queue like any other
+        release(bytes);
+    }
+
+    std::unique_lock<std::mutex> lock(mutex_);
+    Waiter waiter(bytes, nullptr, nullptr);
     {
-        std::lock_guard<std::mutex> lock(mutex_);
-        used_bytes_ -= bytes;
+        std::lock_guard<std::mutex> accounts(accounts_mutex_);
+        waiter.client = &clients_[tenant.client];
+        waiter.bucket = &buckets_[tenant.bucket];
+        if (may_barge() && try_grant(waiter)) {
+            borrowed = waiter.borrowed;
+            return true;
+        }
+        // Keeps the accounts from being forgotten while waiter points at them
+        ++waiter.client->waiting;
+        ++waiter.bucket->waiting;
+    }
+    bool granted = reserve_queued(waiter, lock, &deadline);
+    {
+        std::lock_guard<std::mutex> accounts(accounts_mutex_);
+        --waiter.client->waiting;
+        --waiter.bucket->waiting;
+    }
+    borrowed = waiter.borrowed;
+    return granted;
+}
+
+void RamTracker::release(size_t bytes) {
+    used_bytes_ -= bytes;
+    // Pairs with the increment in reserve_queued: either the waiter sees
+    // this release, or this sees the waiter
+    if (queued_.load() == 0) return;
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (handoff_.load()) {
+        grant_waiters();
+    } else if (!waiters_.empty() && !waiters_.front()->woken) {
+        // The oldest competes for it with new reservations, the releaser's
+        // next one included, instead of being handed it
+        waiters_.front()->woken = true;
+        waiters_.front()->cond.notify_one();
     }
-    cond_.notify_one();
     // too verbose
     // LOG(INFO) << "Released " << bytes << " bytes, total in use: " << used_bytes_ << "\n";
 }
+
+void RamTracker::release(size_t bytes, const Tenant& tenant) {
+    {
+        std::lock_guard<std::mutex> accounts(accounts_mutex_);
+        auto now = std::chrono::steady_clock::now();
+        for (Account* account : {&clients_[tenant.client], &buckets_[tenant.bucket]}) {
+            account->used -= bytes;
+            if (account->used == 0) account->idle_since = now;
+        }
+        if (now - last_idle_sweep_ >= std::chrono::seconds(Constants::RamTenantIdleSec)) forget_idle(now);
+    }
+    // Also wakes a waiter held back by this tenant's caps alone
+    release(bytes);
+}
+
+RamTracker::Stats RamTracker::stats() const {
+    return Stats{used_bytes_.load(), max_bytes_, waits_.load(), wait_time_us_.load(), timeouts_.load()};
+}
+
+std::map<std::string, RamTracker::TenantUsage> RamTracker::client_usage() const {
+    std::lock_guard<std::mutex> lock(accounts_mutex_);
+    std::map<std::string, TenantUsage> usage;
+    for (const auto& [client, account] : clients_) usage[client] = TenantUsage{account.used, account.peak};
+    return usage;
+}
+
+std::map<std::string, RamTracker::TenantUsage> RamTracker::bucket_usage() const {
+    std::lock_guard<std::mutex> lock(accounts_mutex_);
+    std::map<std::string, TenantUsage> usage;
+    for (const auto& [bucket, account] : buckets_) usage[bucket] = TenantUsage{account.used, account.peak};
+    return usage;
+}
+
+// Queues waiter and waits for it to be granted. lock holds mutex_.
+bool RamTracker::reserve_queued(Waiter& waiter, std::unique_lock<std::mutex>& lock,
+                                const std::chrono::steady_clock::time_point* deadline) {
+    auto start = std::chrono::steady_clock::now();
+    waiter.starving_at = start + std::chrono::microseconds(Constants::RamBargeWindowUs);
+    auto it = waiters_.insert(waiters_.end(), &waiter);
+    ++queued_;
+    // Memory released since the fast path failed would otherwise wait for
+    // the next release
+    grant_waiters();
+
+    while (!waiter.granted) {
+        if (deadline && std::chrono::steady_clock::now() >= *deadline) break;
+        if (handoff_.load()) {
+            // Releases grant in order now
+            if (deadline) {
+                waiter.cond.wait_until(lock, *deadline);
+            } else {
+                waiter.cond.wait(lock);
+            }
+        } else {
+            // Woken by a release, or at the end of the window to stop the
+            // overtaking
+            waiter.cond.wait_until(lock, deadline ? std::min(*deadline, waiter.starving_at) : waiter.starving_at);
+        }
+        waiter.woken = false;
+        if (!waiter.granted) grant_waiters();
+    }
+    bool granted = waiter.granted;
+    if (!granted) {
+        waiters_.erase(it);
+        --queued_;
+        ++timeouts_;
+        // Reservations queued behind this one may fit now
+        grant_waiters();
+    }
+    ++waits_;
+    wait_time_us_ += std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::steady_clock::now() - start).count();
+    return granted;
+}
+
+bool RamTracker::within_caps(const Waiter& waiter) const {
+    if (!waiter.client) return true;
+    return (budget_.client_max == 0 || waiter.client->used + waiter.bytes <= budget_.client_max) &&
+           (budget_.bucket_max == 0 || waiter.bucket->used + waiter.bytes <= budget_.bucket_max);
+}
+
+// Whether the reservation stays within every minimum that is set
+bool RamTracker::guaranteed(const Waiter& waiter) const {
+    if (!waiter.client || (budget_.client_min == 0 && budget_.bucket_min == 0)) return false;
+    return (budget_.client_min == 0 || waiter.client->used + waiter.bytes <= budget_.client_min) &&
+           (budget_.bucket_min == 0 || waiter.bucket->used + waiter.bytes <= budget_.bucket_min);
+}
+
+// Reserves for waiter if its caps and the global budget allow. Requires
+// accounts_mutex_.
+bool RamTracker::try_grant(Waiter& waiter) {
+    if (!within_caps(waiter) || !add_if_fits(waiter.bytes)) return false;
+    charge(waiter);
+    return true;
+}
+
+// Charges waiter's bytes, already taken from the global budget, to its
+// tenant and marks it granted. Requires accounts_mutex_.
+void RamTracker::charge(Waiter& waiter) {
+    waiter.borrowed = (budget_.client_min > 0 || budget_.bucket_min > 0) && !guaranteed(waiter);
+    if (waiter.client) {
+        for (Account* account : {waiter.client, waiter.bucket}) {
+            account->used += waiter.bytes;
+            account->peak = std::max(account->peak, account->used);
+        }
+    }
+    waiter.granted = true;
+}
+
+// Drops accounts that have held nothing for RamTenantIdleSec, so client ids
+// seen once do not stay forever. Requires accounts_mutex_.
+void RamTracker::forget_idle(std::chrono::steady_clock::time_point now) {
+    last_idle_sweep_ = now;
+    for (auto* accounts : {&clients_, &buckets_}) {
+        for (auto it = accounts->begin(); it != accounts->end();) {
+            const Account& account = it->second;
+            bool idle = account.used == 0 && account.waiting == 0 &&
+                        now - account.idle_since >= std::chrono::seconds(Constants::RamTenantIdleSec);
+            it = idle ? accounts->erase(it) : std::next(it);
+        }
+    }
+}
+
+// Grants queued reservations: those within their guaranteed minimum first,
+// then the rest oldest first. One held back by its own caps does not hold
+// up the others; one held back by the global budget does, so later and
+// smaller ones cannot starve it. Also decides whether the barging window is
+// over. Requires mutex_.
+void RamTracker::grant_waiters() {
+    std::lock_guard<std::mutex> accounts(accounts_mutex_);
+    bool blocked = false;
+    bool owner_blocked = false;
+    for (bool owners : {true, false}) {
+        for (auto it = waiters_.begin(); !blocked && it != waiters_.end();) {
+            Waiter* waiter = *it;
+            if (guaranteed(*waiter) != owners || !within_caps(*waiter)) {
+                ++it;
+                continue;
+            }
+            if (!try_grant(*waiter)) {
+                blocked = true;
+                owner_blocked = owners;
+                break;
+            }
+            it = waiters_.erase(it);
+            --queued_;
+            waiter->cond.notify_one();
+        }
+    }
+    reclaim_wanted_ = owner_blocked;
+    handoff_ = !waiters_.empty() && std::chrono::steady_clock::now() >= waiters_.front()->starving_at;
+}
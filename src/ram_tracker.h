@@ -1,25 +1,134 @@
 #pragma once
-#include <mutex>
+#include <atomic>
+#include <chrono>
 #include <condition_variable>
+#include <list>
+#include <map>
+#include <mutex>
+#include <string>
+#include <unordered_map>
 #include <glog/logging.h>
 
+// Byte budget shared by the RAM tier and the stream buffers. Reservations
+// that fit take a lock-free path; the rest queue up and are granted in
+// arrival order. New reservations may overtake the queue only until its
+// oldest has waited RamBargeWindowUs. From then on, releases hand memory to
+// the queue in order, so a large reservation cannot be starved by a stream
+// of small ones. Until then, a thread that releases and reserves again keeps
+// going instead of trading places with a sleeping waiter.
+//
+// Stream buffers are also charged to the client and the bucket they serve.
+// Each has a cap, and a guaranteed minimum: a reservation that keeps both
+// within their minimum is granted ahead of the queue, and while one waits
+// for memory, reclaim_wanted() asks holders of borrowed memory (anything
+// past a minimum) to give it back. Tenant reservations take the same
+// lock-free path for the global budget and lock only to charge the tenant.
+// A client or bucket holding nothing for RamTenantIdleSec is forgotten.
 class RamTracker {
 public:
-    explicit RamTracker(size_t max_bytes);
+    struct Stats {
+        size_t used_bytes;
+        size_t max_bytes;
+        size_t waits;           // reservations that had to queue
+        size_t wait_time_us;    // total time spent queued
+        size_t timeouts;        // queued reservations that hit their deadline
+    };
+
+    // Per-client and per-bucket limits in bytes; 0 turns a limit off
+    struct TenantBudget {
+        size_t client_max = 0;
+        size_t client_min = 0;
+        size_t bucket_max = 0;
+        size_t bucket_min = 0;
+    };
+
+    struct Tenant {
+        std::string client;
+        std::string bucket;
+    };
 
-    // Try to reserve memory. Returns false if not enough available.
+    struct TenantUsage {
+        size_t used;
+        size_t peak;
+    };
+
+    RamTracker(size_t max_bytes, const TenantBudget& budget);
+
+    // Try to reserve memory. Returns false if not enough available, or if
+    // earlier reservations are still waiting.
     bool try_reserve(size_t bytes);
 
     // Blocks until memory is available, then reserves.
     void wait_and_reserve(size_t bytes);
 
+    // Like wait_and_reserve, but gives up at deadline. Returns whether the
+    // memory was reserved.
+    bool try_reserve_until(size_t bytes, std::chrono::steady_clock::time_point deadline);
+
+    // Reserves for tenant, within its client's and bucket's caps as well as
+    // the global budget. borrowed is set when the memory is past a minimum
+    // and should be given back once reclaim_wanted().
+    bool try_reserve_until(size_t bytes, std::chrono::steady_clock::time_point deadline, const Tenant& tenant,
+                           bool& borrowed);
+
     // Releases memory back to the pool.
     void release(size_t bytes);
+    void release(size_t bytes, const Tenant& tenant);
+
+    // True while a reservation within its guaranteed minimum is waiting
+    bool reclaim_wanted() const { return reclaim_wanted_.load(); }
+
+    Stats stats() const;
+    std::map<std::string, TenantUsage> client_usage() const;
+    std::map<std::string, TenantUsage> bucket_usage() const;
 
 private:
+    struct Account {
+        size_t used = 0;
+        size_t peak = 0;
+        size_t waiting = 0;     // queued reservations pointing at this account
+        std::chrono::steady_clock::time_point idle_since;
+    };
+
+    struct Waiter {
+        Waiter(size_t bytes, Account* client, Account* bucket) : bytes(bytes), client(client), bucket(bucket) {}
+        size_t bytes;
+        Account* client;        // both null for untagged reservations
+        Account* bucket;
+        bool granted = false;
+        bool borrowed = false;
+        bool woken = false;     // notified to compete for released memory
+        std::chrono::steady_clock::time_point starving_at;  // end of its barging window
+        std::condition_variable cond;
+    };
+
     const size_t max_bytes_;
-    size_t used_bytes_;
+    const TenantBudget budget_;
+    std::atomic<size_t> used_bytes_;
+    std::atomic<size_t> queued_;
+    std::atomic<bool> handoff_;     // the oldest waiter is past its barging window
+    std::atomic<bool> reclaim_wanted_;
+    std::atomic<size_t> waits_;
+    std::atomic<size_t> wait_time_us_;
+    std::atomic<size_t> timeouts_;
 
     mutable std::mutex mutex_;
-    std::condition_variable cond_;
+    std::list<Waiter*> waiters_;    // oldest first
+
+    // Taken after mutex_ when both are needed
+    mutable std::mutex accounts_mutex_;
+    std::unordered_map<std::string, Account> clients_;
+    std::unordered_map<std::string, Account> buckets_;
+    std::chrono::steady_clock::time_point last_idle_sweep_;
+
+    bool may_barge() const { return queued_.load() == 0 || !handoff_.load(); }
+    bool add_if_fits(size_t bytes);
+    void charge(Waiter& waiter);
+    void forget_idle(std::chrono::steady_clock::time_point now);
+    bool reserve_queued(Waiter& waiter, std::unique_lock<std::mutex>& lock,
+                        const std::chrono::steady_clock::time_point* deadline);
+    bool within_caps(const Waiter& waiter) const;
+    bool guaranteed(const Waiter& waiter) const;
+    bool try_grant(Waiter& waiter);
+    void grant_waiters();
 };
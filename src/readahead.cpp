@@ -0,0 +1,109 @@
+#include "readahead.h"
+#include <algorithm>
+#include <cmath>
+#include "constants.h"
+
+Readahead::Readahead(Fetch fetch, size_t max_window, size_t budget_bytes)
+    : fetch_(std::move(fetch)), max_window_(max_window), budget_bytes_(budget_bytes) {
+    for (size_t i = 0; i < Constants::ReadaheadWorkers; ++i) {
+        workers_.emplace_back(&Readahead::run_worker, this);
+    }
+}
+
+Readahead::~Readahead() {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stopping_ = true;
+    }
+    cond_.notify_all();
+    for (auto& worker : workers_) worker.join();
+}
+
+void Readahead::on_block_read(const std::string& client_id, const std::string& bucket, const std::string& file,
+                              const std::string& blocks_key, int64_t generation, size_t index, size_t block_count,
+                              size_t block_size, uint64_t object_size) {
+    auto now = std::chrono::steady_clock::now();
+    std::string stream_key = client_id + "|" + blocks_key;
+    bool queued = false;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto it = streams_.find(stream_key);
+        if (it == streams_.end()) {
+            drop_idle_streams_locked(now);
+            streams_[stream_key] = Stream{index, index + 1, 0, now};
+            return;
+        }
+
+        Stream& stream = it->second;
+        // Small ranges often land in the block read last time
+        if (index == stream.last_index) return;
+        if (index != stream.last_index + 1) {
+            stream = Stream{index, index + 1, 0, now};
+            return;
+        }
+
+        double elapsed_ms = std::chrono::duration<double, std::milli>(now - stream.last_access).count();
+        stream.interval_ms = stream.interval_ms > 0 ? 0.75 * stream.interval_ms + 0.25 * elapsed_ms : elapsed_ms;
+        stream.last_index = index;
+        stream.last_access = now;
+
+        size_t until = std::min(block_count, index + 1 + window_locked(stream));
+        for (size_t next = std::max(stream.prefetched_until, index + 1); next < until; ++next) {
+            uint64_t begin = next * block_size;
+            uint64_t end = std::min<uint64_t>(begin + block_size, object_size);
+            if (bytes_in_flight_ + (end - begin) > budget_bytes_) break;
+            bytes_in_flight_ += end - begin;
+            queue_.push_back(CacheUnit{bucket, file, blocks_key + std::to_string(next),
+                                       static_cast<int64_t>(begin), static_cast<int64_t>(end), generation});
+            stream.prefetched_until = next + 1;
+            queued = true;
+        }
+    }
+    if (queued) cond_.notify_all();
+}
+
+// Enough blocks ahead to cover one fill at the client's current pace, plus
+// one to absorb jitter
+size_t Readahead::window_locked(const Stream& stream) const {
+    if (fill_ms_ <= 0 || stream.interval_ms <= 0) return std::min<size_t>(2, max_window_);
+    size_t window = static_cast<size_t>(std::ceil(fill_ms_ / stream.interval_ms)) + 1;
+    return std::clamp<size_t>(window, 1, max_window_);
+}
+
+void Readahead::drop_idle_streams_locked(std::chrono::steady_clock::time_point now) {
+    if (streams_.size() < Constants::ReadaheadMaxStreams) return;
+    for (auto it = streams_.begin(); it != streams_.end();) {
+        if (now - it->second.last_access > std::chrono::milliseconds(Constants::ReadaheadStreamIdleMs)) {
+            it = streams_.erase(it);
+        } else {
+            ++it;
+        }
+    }
+    if (streams_.size() >= Constants::ReadaheadMaxStreams) streams_.clear();
+}
+
+void Readahead::run_worker() {
+    while (true) {
+        CacheUnit unit;
+        {
+            std::unique_lock<std::mutex> lock(mutex_);
+            cond_.wait(lock, [&] { return stopping_ || !queue_.empty(); });
+            if (stopping_) return;
+            unit = std::move(queue_.front());
+            queue_.pop_front();
+        }
+
+        auto start = std::chrono::steady_clock::now();
+        bool filled = false;
+        try {
+            filled = fetch_(unit);
+        } catch (const std::exception& e) {
+            LOG(WARNING) << "[READAHEAD] Prefetch of " << unit.key << " failed: " << e.what() << "\n";
+        }
+        double fill_ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+        std::lock_guard<std::mutex> lock(mutex_);
+        bytes_in_flight_ -= unit.range_end - unit.range_begin;
+        if (filled) fill_ms_ = fill_ms_ > 0 ? 0.75 * fill_ms_ + 0.25 * fill_ms : fill_ms;
+    }
+}
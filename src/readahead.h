@@ -0,0 +1,62 @@
+#pragma once
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+#include "gcs_cache.h"
+
+// Detects clients reading an object's blocks in order and fetches the next
+// ones before they are asked for. The window is sized from how fast the
+// client consumes blocks against how long a block takes to fill, so a fast
+// reader gets more blocks ahead and a slow one fewer. Prefetches run on a
+// few worker threads and are capped by their own budget of bytes in flight,
+// separate from the fills client misses start.
+class Readahead {
+public:
+    // Fetches one unit into the cache and returns once it is there. Returns
+    // false if it was already cached or in flight, or was not admitted.
+    using Fetch = std::function<bool(const CacheUnit& unit)>;
+
+    Readahead(Fetch fetch, size_t max_window, size_t budget_bytes);
+    ~Readahead();
+
+    Readahead(const Readahead&) = delete;
+    Readahead& operator=(const Readahead&) = delete;
+
+    // Called as a client opens block index of an object split into
+    // block_count blocks of block_size bytes, read at generation. A block's
+    // cache key is blocks_key followed by its index.
+    void on_block_read(const std::string& client_id, const std::string& bucket, const std::string& file,
+                       const std::string& blocks_key, int64_t generation, size_t index, size_t block_count,
+                       size_t block_size, uint64_t object_size);
+
+private:
+    struct Stream {
+        size_t last_index = 0;
+        size_t prefetched_until = 0;    // blocks below this are queued or fetched
+        double interval_ms = 0;         // average time between block reads
+        std::chrono::steady_clock::time_point last_access;
+    };
+
+    Fetch fetch_;
+    const size_t max_window_;
+    const size_t budget_bytes_;
+
+    std::mutex mutex_;
+    std::condition_variable cond_;
+    std::unordered_map<std::string, Stream> streams_;
+    std::deque<CacheUnit> queue_;
+    size_t bytes_in_flight_ = 0;    // queued or being fetched
+    double fill_ms_ = 0;            // average time to fill one block
+    bool stopping_ = false;
+    std::vector<std::thread> workers_;
+
+    size_t window_locked(const Stream& stream) const;
+    void drop_idle_streams_locked(std::chrono::steady_clock::time_point now);
+    void run_worker();
+};
@@ -0,0 +1,46 @@
+#include "scrubber.h"
+#include <chrono>
+#include <glog/logging.h>
+#include <sys/resource.h>
+#include "constants.h"
+
+Scrubber::Scrubber(List list, Verify verify, size_t bytes_per_sec)
+    : list_(std::move(list)), verify_(std::move(verify)), bytes_per_sec_(bytes_per_sec),
+      thread_(&Scrubber::run, this) {}
+
+Scrubber::~Scrubber() {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stopping_ = true;
+    }
+    cond_.notify_all();
+    thread_.join();
+}
+
+bool Scrubber::pause(double ms) {
+    std::unique_lock<std::mutex> lock(mutex_);
+    return !cond_.wait_for(lock, std::chrono::duration<double, std::milli>(ms), [&] { return stopping_; });
+}
+
+void Scrubber::run() {
+    // On Linux this lowers only the calling thread
+    ::setpriority(PRIO_PROCESS, 0, Constants::ScrubNice);
+    if (!pause(Constants::ScrubStartDelayMs)) return;
+
+    while (true) {
+        auto keys = list_();
+        size_t checked = 0;
+        for (const auto& key : keys) {
+            size_t bytes = 0;
+            try {
+                bytes = verify_(key);
+            } catch (const std::exception& e) {
+                LOG(WARNING) << "[SCRUB] Verifying " << key << " failed: " << e.what() << "\n";
+            }
+            if (bytes > 0) ++checked;
+            if (!pause(1000.0 * bytes / bytes_per_sec_)) return;
+        }
+        LOG(INFO) << "[SCRUB] Pass done, checked " << checked << " of " << keys.size() << " entries\n";
+        if (!pause(Constants::ScrubPassIntervalMs)) return;
+    }
+}
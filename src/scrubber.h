@@ -0,0 +1,41 @@
+#pragma once
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Background pass that re-reads cached entries and checks them against the
+// CRC32C taken when they were filled, so bit rot or a file truncated by a
+// crash is caught before a client is served it. Works coldest first, since
+// cold entries go longest without anyone reading them, on one low-priority
+// thread capped at bytes_per_sec. Each pass is followed by a pause.
+class Scrubber {
+public:
+    // Keys worth verifying, coldest first
+    using List = std::function<std::vector<std::string>()>;
+    // Verifies one entry and evicts it if it is corrupt. Returns the bytes
+    // it read.
+    using Verify = std::function<size_t(const std::string& key)>;
+
+    Scrubber(List list, Verify verify, size_t bytes_per_sec);
+    ~Scrubber();
+
+    Scrubber(const Scrubber&) = delete;
+    Scrubber& operator=(const Scrubber&) = delete;
+
+private:
+    List list_;
+    Verify verify_;
+    const size_t bytes_per_sec_;
+
+    std::mutex mutex_;
+    std::condition_variable cond_;
+    bool stopping_ = false;
+    std::thread thread_;
+
+    // Sleeps for ms unless stopping; returns false once stopping
+    bool pause(double ms);
+    void run();
+};
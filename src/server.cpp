@@ -1,12 +1,65 @@
 #include "server.h"
 #include "httplib.h"
+#include "warmup_jobs.h"
+#include "manifest_prefetcher.h"
+#include "crc32c.h"
+#include <algorithm>
+#include <cctype>
+#include <cstdlib>
+#include <map>
 #include <unordered_map>
 #include <mutex>
-#include <fstream>
+#include <thread>
+#include <sstream>
 #include <chrono>
+#include <ctime>
+
+static std::string json_escape(const std::string& text) {
+    std::string escaped;
+    for (char c : text) {
+        if (c == '"' || c == '\\') escaped += '\\';
+        if (static_cast<unsigned char>(c) < 0x20) c = ' ';
+        escaped += c;
+    }
+    return escaped;
+}
+
+// Whether Accept-Encoding lists zstd, and not with q=0
+static bool accepts_zstd(const httplib::Request& req) {
+    std::istringstream codings(req.get_header_value("Accept-Encoding"));
+    std::string coding;
+    while (std::getline(codings, coding, ',')) {
+        coding.erase(std::remove_if(coding.begin(), coding.end(), [](unsigned char c) { return std::isspace(c); }),
+                     coding.end());
+        if (coding.compare(0, 4, "zstd") != 0 || (coding.size() > 4 && coding[4] != ';')) continue;
+        size_t q = coding.find(";q=");
+        return q == std::string::npos || std::strtod(coding.c_str() + q + 3, nullptr) > 0;
+    }
+    return false;
+}
+
+// Object lists are "<bucket> <file>" lines, or "<file>" lines in
+// default_bucket
+static std::vector<std::pair<std::string, std::string>> parse_object_lines(const std::string& body,
+                                                                           const std::string& default_bucket) {
+    std::vector<std::pair<std::string, std::string>> objects;
+    std::istringstream lines(body);
+    std::string line;
+    while (std::getline(lines, line)) {
+        std::istringstream fields(line);
+        std::string first, second;
+        if (!(fields >> first)) continue;
+        if (fields >> second) objects.emplace_back(first, second);
+        else if (!default_bucket.empty()) objects.emplace_back(default_bucket, first);
+    }
+    return objects;
+}
 
 CacheServer::CacheServer(std::shared_ptr<GCSCache> cache, const QosConfig& qos_config, int port)
-    : cache_(cache), qos_config_(qos_config), port_(port) {}
+    : cache_(cache), qos_config_(qos_config), port_(port),
+      // About one pacing interval's worth of the bandwidth limit
+      stream_buffer_size_(std::clamp(qos_config.max_bandwidth_bps / (1000 / Constants::BandwidthRetryDelay),
+                                     Constants::BufferPoolMinBuffer, Constants::BufferPoolMaxBuffer)) {}
 
     
 void CacheServer::run() {
@@ -17,14 +70,45 @@ void CacheServer::run() {
         if (!parsed) return;
     
         auto [bucket, file, client_id] = *parsed;
+        // Naming a generation pins the read to it
+        int64_t generation = 0;
+        if (req.has_param("generation")) {
+            try {
+                generation = std::stoll(req.get_param_value("generation"));
+            } catch (const std::exception&) {
+                res.status = HttpStatus::BadRequest;
+                res.set_content("Invalid generation", "text/plain");
+                return;
+            }
+        }
+
+        // httplib routes HEAD here too; it only needs the metadata
+        if (req.method == "HEAD") {
+            send_object_metadata(bucket, file, generation, res);
+            return;
+        }
     
         lock_and_initialize_client(client_id);
         if (!check_concurrency_limit(client_id, res)) return;
     
         try {
-            auto client = cache_->get_client(qos_config_);
-            auto file_path = client->get_object(file, bucket);
-            stream_file_to_client(client_id, file_path, res);
+            auto client = cache_->get_client(client_id, qos_config_);
+            res.set_header("Accept-Ranges", "bytes");
+            res.set_header("Vary", "Accept-Encoding");
+            if (req.ranges.empty()) {
+                auto reader = client->get_object(file, bucket, generation, accepts_zstd(req));
+                // Cached compressed, and sent as it is stored
+                if (!reader->content_encoding().empty()) {
+                    res.set_header("Content-Encoding", reader->content_encoding());
+                }
+                stream_object_to_client(client_id, bucket, reader, res);
+            } else {
+                auto reader = client->get_object_for_range(file, bucket, generation);
+                stream_ranges_to_client(client_id, bucket, reader, res);
+            }
+        } catch (const ObjectNotFound& e) {
+            res.status = HttpStatus::NotFound;
+            res.set_content(e.what(), "text/plain");
         } catch (const std::exception& e) {
             res.status = HttpStatus::InternalServerError;
             res.set_content(e.what(), "text/plain");
@@ -32,6 +116,129 @@ void CacheServer::run() {
         decrement_concurrency(client_id);
     });
 
+    // Warm-up: an object list in the body and/or everything under
+    // ?bucket=&prefix=
+    svr.Post("/prefetch", [&](const httplib::Request& req, httplib::Response& res) {
+        std::string bucket = req.get_param_value("bucket");
+        auto objects = parse_object_lines(req.body, bucket);
+
+        bool has_prefix = req.has_param("prefix") && !bucket.empty();
+        if (objects.empty() && !has_prefix) {
+            res.status = HttpStatus::BadRequest;
+            res.set_content("Nothing to prefetch: send '<bucket> <file>' lines or ?bucket=&prefix=", "text/plain");
+            return;
+        }
+
+        uint64_t job_id = cache_->warmup_jobs().submit(std::move(objects), has_prefix ? bucket : "",
+                                                       req.get_param_value("prefix"));
+        res.status = HttpStatus::Accepted;
+        res.set_content("{\"job_id\": " + std::to_string(job_id) + "}", "application/json");
+    });
+
+    svr.Get("/prefetch", [&](const httplib::Request& req, httplib::Response& res) {
+        std::optional<WarmupProgress> progress;
+        try {
+            progress = cache_->warmup_jobs().progress(std::stoull(req.get_param_value("job_id")));
+        } catch (const std::exception&) {
+            res.status = HttpStatus::BadRequest;
+            res.set_content("Missing or invalid query parameter: 'job_id'", "text/plain");
+            return;
+        }
+        if (!progress) {
+            res.status = HttpStatus::NotFound;
+            res.set_content("Unknown job_id", "text/plain");
+            return;
+        }
+
+        std::ostringstream body;
+        body << "{\"state\": \"" << progress->state << "\""
+             << ", \"objects_total\": " << progress->objects_total
+             << ", \"objects_done\": " << progress->objects_done
+             << ", \"objects_failed\": " << progress->objects_failed
+             << ", \"objects_skipped\": " << progress->objects_skipped
+             << ", \"bytes\": " << progress->bytes
+             << ", \"errors\": [";
+        for (size_t i = 0; i < progress->errors.size(); ++i) {
+            body << (i ? ", " : "") << "\"" << json_escape(progress->errors[i]) << "\"";
+        }
+        body << "]}";
+        res.set_content(body.str(), "application/json");
+    });
+
+    // A client's ordered manifest; an empty body unregisters it
+    svr.Post("/manifest", [&](const httplib::Request& req, httplib::Response& res) {
+        if (!req.has_param("client_id")) {
+            res.status = HttpStatus::BadRequest;
+            res.set_content("Missing query parameter: 'client_id'", "text/plain");
+            return;
+        }
+        auto objects = parse_object_lines(req.body, req.get_param_value("bucket"));
+        size_t length = objects.size();
+        cache_->manifests().register_manifest(req.get_param_value("client_id"), std::move(objects));
+        res.set_content("{\"length\": " + std::to_string(length) + "}", "application/json");
+    });
+
+    svr.Get("/manifest", [&](const httplib::Request& req, httplib::Response& res) {
+        auto progress = cache_->manifests().progress(req.get_param_value("client_id"));
+        if (!progress) {
+            res.status = HttpStatus::NotFound;
+            res.set_content("No manifest for client_id", "text/plain");
+            return;
+        }
+        std::ostringstream body;
+        body << "{\"length\": " << progress->length
+             << ", \"position\": " << progress->position
+             << ", \"epoch\": " << progress->epoch << "}";
+        res.set_content(body.str(), "application/json");
+    });
+
+    // Forgets remembered 404s: ?bucket=&file= for one object, ?bucket= for
+    // a bucket, neither for all
+    svr.Delete("/negative", [&](const httplib::Request& req, httplib::Response& res) {
+        size_t purged = cache_->purge_negative(req.get_param_value("bucket"), req.get_param_value("file"));
+        res.set_content("{\"purged\": " + std::to_string(purged) + "}", "application/json");
+    });
+
+    svr.Get("/stats", [&](const httplib::Request&, httplib::Response& res) {
+        auto stats = cache_->stats();
+        auto ram = cache_->ram_tracker().stats();
+        size_t requests = stats.hits + stats.ram_hits + stats.misses;
+        double hit_ratio = requests ? double(stats.hits + stats.ram_hits) / requests : 0.0;
+        std::ostringstream body;
+        body << "{\"hits\": " << stats.hits
+             << ", \"ram_hits\": " << stats.ram_hits
+             << ", \"misses\": " << stats.misses
+             << ", \"bypassed\": " << stats.bypassed
+             << ", \"prefetched\": " << stats.prefetched
+             << ", \"corrupt\": " << stats.corrupt
+             << ", \"revalidated\": " << stats.revalidated
+             << ", \"stale\": " << stats.stale
+             << ", \"negative_hits\": " << stats.negative_hits
+             << ", \"hit_ratio\": " << hit_ratio
+             << ", \"disk_bytes\": " << stats.disk_bytes
+             << ", \"logical_bytes\": " << stats.logical_bytes
+             << ", \"ram_used\": " << ram.used_bytes
+             << ", \"ram_max\": " << ram.max_bytes
+             << ", \"ram_waits\": " << ram.waits
+             << ", \"ram_wait_us\": " << ram.wait_time_us
+             << ", \"ram_timeouts\": " << ram.timeouts;
+        // What each client and bucket holds now and at most, for sizing max_ram
+        auto write_usage = [&](const char* name, const std::map<std::string, RamTracker::TenantUsage>& usage) {
+            body << ", \"" << name << "\": {";
+            const char* separator = "";
+            for (const auto& [tenant, tenant_usage] : usage) {
+                body << separator << "\"" << json_escape(tenant) << "\": {\"used\": " << tenant_usage.used
+                     << ", \"peak\": " << tenant_usage.peak << "}";
+                separator = ", ";
+            }
+            body << "}";
+        };
+        write_usage("ram_clients", cache_->ram_tracker().client_usage());
+        write_usage("ram_buckets", cache_->ram_tracker().bucket_usage());
+        body << "}";
+        res.set_content(body.str(), "application/json");
+    });
+
     svr.listen("0.0.0.0", port_);
 }
 
@@ -74,39 +281,133 @@ bool CacheServer::check_bandwidth_limit(const std::string& client_id, size_t byt
     return true;
 }
 
-void CacheServer::stream_file_to_client(const std::string& client_id,
-                                        const std::string& file_path,
-                                        httplib::Response& res) {
-    auto ifs = std::make_shared<std::ifstream>(file_path, std::ios::binary);
-    if (!ifs || !ifs->is_open()) {
-        LOG(ERROR) << "Failed to open file: " << file_path << "\n";
-        throw std::runtime_error("Failed to open file"); // perhaps not the best for production? 
+// Sends the reader's next bytes, at most length, and returns how many went
+// out, 0 if the object ended early or failed. Bytes in a cached file go from
+// the page cache to the socket with sendfile() in paced segments; RAM tier
+// and upstream bytes are copied through buffer, leased from the pool for
+// tenant the first time the stream needs it and kept until the stream ends,
+// or until borrowed memory is reclaimed.
+size_t CacheServer::send_next(const RamTracker::Tenant& tenant, ObjectReader& reader, BufferPool::Lease& buffer,
+                              size_t length, httplib::DataSink& sink) {
+    const std::string& client_id = tenant.client;
+    auto pace = [&](size_t bytes) {
+        while (!check_bandwidth_limit(client_id, bytes)) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(Constants::BandwidthRetryDelay));
+        }
+    };
+    try {
+        if (sink.send_file) {
+            // A segment must fit in one second's bandwidth allowance
+            size_t segment = std::min({length, Constants::SendfileSegmentSize, qos_config_.max_bandwidth_bps});
+            size_t sent = reader.send(segment, [&](int fd, size_t offset, size_t len) {
+                pace(len);
+                sink.send_file(fd, offset, len);
+            });
+            if (sent > 0) return sent;
+        }
+
+        if (!buffer) {
+            // Waits for max_ram to have room for it
+            buffer = cache_->buffer_pool().lease(stream_buffer_size_, std::chrono::steady_clock::now() +
+                                                 std::chrono::seconds(Constants::BufferLeaseTimeoutSec), tenant);
+            if (!buffer) throw std::runtime_error("No stream buffer free within max_ram");
+        }
+        // Blocks while an in-flight fill has not written this far yet
+        size_t bytes_read = reader.read(buffer.data(), std::min(length, buffer.size()));
+        if (bytes_read > 0) {
+            pace(bytes_read);
+            sink.write(buffer.data(), bytes_read);
+        }
+        // The next segment leases again, queued behind whoever needs it back
+        if (buffer.borrowed() && cache_->ram_tracker().reclaim_wanted()) buffer.reset();
+        return bytes_read;
+    } catch (const std::exception& e) {
+        LOG(ERROR) << "[REQ] Aborting stream to client_id=" << client_id << ": " << e.what() << "\n";
+        return 0;
     }
-    LOG(INFO) << "[REQ] Streaming file: " << file_path << " to client_id=" << client_id << "\n";
-    res.set_chunked_content_provider("application/octet-stream",
-        [this, client_id, ifs](size_t offset, httplib::DataSink& sink) mutable {
-            cache_->ram_tracker().wait_and_reserve(Constants::StreamBufferSize);
-            char buffer[Constants::StreamBufferSize];
-            ifs->read(buffer, sizeof(buffer));
-            size_t bytes_read = ifs->gcount();
-
-            if (bytes_read > 0) {
-                while (!check_bandwidth_limit(client_id, bytes_read)) {
-                    std::this_thread::sleep_for(std::chrono::milliseconds(Constants::BandwidthRetryDelay));
-                }
-                sink.write(buffer, bytes_read);
-            }
+}
 
-            if (ifs->eof()) {
-                sink.done();
-                decrement_concurrency(client_id);
-            }
-            cache_->ram_tracker().release(Constants::StreamBufferSize);
-            return true;
+void CacheServer::stream_object_to_client(const std::string& client_id, const std::string& bucket,
+                                          std::shared_ptr<ObjectReader> reader,
+                                          httplib::Response& res) {
+    LOG(INFO) << "[REQ] Streaming object to client_id=" << client_id << "\n";
+    // Every reader knows the object's size before its first byte, fills
+    // included, so the response carries a Content-Length
+    auto buffer = std::make_shared<BufferPool::Lease>();
+    RamTracker::Tenant tenant{client_id, bucket};
+    res.set_content_provider(reader->size(), "application/octet-stream",
+        [this, tenant, reader, buffer](size_t, size_t length, httplib::DataSink& sink) {
+            // Short of the promised length: drop the connection
+            return send_next(tenant, *reader, *buffer, length, sink) > 0;
+        },
+        [this, client_id, buffer](bool) {
+            buffer->reset();
+            decrement_concurrency(client_id);
         });
     LOG(INFO) << "[REQ] HttpStatus::Ok for client_id=" << client_id << "\n";
 }
 
+// Serves req.ranges from a sized provider: httplib validates the ranges
+// against the object size (416 if unsatisfiable), writes the 206 headers or
+// multipart/byteranges framing, and asks for each range's bytes in turn.
+void CacheServer::stream_ranges_to_client(const std::string& client_id, const std::string& bucket,
+                                          std::shared_ptr<ObjectReader> reader,
+                                          httplib::Response& res) {
+    LOG(INFO) << "[REQ] Streaming ranges to client_id=" << client_id << "\n";
+    auto next_offset = std::make_shared<size_t>(std::string::npos);
+    auto buffer = std::make_shared<BufferPool::Lease>();
+    RamTracker::Tenant tenant{client_id, bucket};
+    res.set_content_provider(reader->size(), "application/octet-stream",
+        [this, client_id, tenant, reader, next_offset, buffer](size_t offset, size_t length,
+                                                               httplib::DataSink& sink) {
+            try {
+                // A new range: position the reader and tell it where the range ends
+                if (offset != *next_offset) reader->seek(offset, offset + length);
+            } catch (const std::exception& e) {
+                LOG(ERROR) << "[REQ] Aborting ranges to client_id=" << client_id << ": " << e.what() << "\n";
+                return false;
+            }
+            size_t sent = send_next(tenant, *reader, *buffer, length, sink);
+            *next_offset = offset + sent;
+            return sent > 0;
+        },
+        [this, client_id, buffer](bool) {
+            buffer->reset();
+            decrement_concurrency(client_id);
+        });
+}
+
+// HEAD /object: the headers a GET would send, from the metadata cache,
+// without reading or filling the object
+void CacheServer::send_object_metadata(const std::string& bucket, const std::string& file, int64_t generation,
+                                       httplib::Response& res) {
+    ObjectMetadata metadata;
+    try {
+        metadata = cache_->object_metadata(bucket, file, generation);
+    } catch (const ObjectNotFound&) {
+        res.status = HttpStatus::NotFound;
+        return;
+    } catch (const std::exception& e) {
+        LOG(ERROR) << "[REQ] Metadata of " << bucket << "/" << file << " failed: " << e.what() << "\n";
+        res.status = HttpStatus::InternalServerError;
+        return;
+    }
+
+    char updated[64];
+    std::time_t updated_time = std::chrono::system_clock::to_time_t(metadata.updated);
+    std::tm updated_tm;
+    gmtime_r(&updated_time, &updated_tm);
+    std::strftime(updated, sizeof(updated), "%a, %d %b %Y %H:%M:%S GMT", &updated_tm);
+
+    res.set_header("Content-Length", std::to_string(metadata.size));
+    res.set_header("Content-Type", metadata.content_type.empty() ? "application/octet-stream" : metadata.content_type);
+    res.set_header("Accept-Ranges", "bytes");
+    res.set_header("Last-Modified", updated);
+    res.set_header("x-goog-generation", std::to_string(metadata.generation));
+    res.set_header("x-goog-metageneration", std::to_string(metadata.metageneration));
+    if (metadata.crc32c) res.set_header("x-goog-hash", "crc32c=" + Crc32c::to_base64(*metadata.crc32c));
+}
+
 void CacheServer::lock_and_initialize_client(const std::string& id) {
     std::lock_guard<std::mutex> lock(state_mutex_);
     if (client_states_.find(id) == client_states_.end()) {
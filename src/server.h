@@ -28,6 +28,7 @@ private:
     std::shared_ptr<GCSCache> cache_;
     QosConfig qos_config_;
     int port_;
+    size_t stream_buffer_size_;
 
     std::mutex state_mutex_;
     std::unordered_map<std::string, ClientState> client_states_;
@@ -35,7 +36,14 @@ private:
     std::optional<req_params> parse_request_params(const httplib::Request& req, httplib::Response& res);
     bool check_concurrency_limit(const std::string& client_id, httplib::Response& res);
     bool check_bandwidth_limit(const std::string& client_id, size_t bytes);
-    void stream_file_to_client(const std::string& client_id, const std::string& file_path, httplib::Response& res);
+    size_t send_next(const RamTracker::Tenant& tenant, ObjectReader& reader, BufferPool::Lease& buffer, size_t length,
+                     httplib::DataSink& sink);
+    void stream_object_to_client(const std::string& client_id, const std::string& bucket,
+                                 std::shared_ptr<ObjectReader> reader, httplib::Response& res);
+    void send_object_metadata(const std::string& bucket, const std::string& file, int64_t generation,
+                              httplib::Response& res);
+    void stream_ranges_to_client(const std::string& client_id, const std::string& bucket,
+                                 std::shared_ptr<ObjectReader> reader, httplib::Response& res);
     void lock_and_initialize_client(const std::string& id);
     void decrement_concurrency(const std::string& id);
 };
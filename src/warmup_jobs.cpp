@@ -0,0 +1,140 @@
+#include "warmup_jobs.h"
+#include "gcs_cache.h"
+#include "constants.h"
+
+WarmupJobs::WarmupJobs(GCSCache& cache, size_t concurrency, uint64_t disk_budget)
+    : cache_(cache), disk_budget_(disk_budget) {
+    for (size_t i = 0; i < concurrency; ++i) {
+        workers_.emplace_back(&WarmupJobs::run_worker, this);
+    }
+}
+
+WarmupJobs::~WarmupJobs() {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stopping_ = true;
+    }
+    cond_.notify_all();
+    for (auto& worker : workers_) worker.join();
+}
+
+uint64_t WarmupJobs::submit(ObjectList objects, const std::string& prefix_bucket, const std::string& prefix) {
+    auto job = std::make_shared<Job>();
+    job->listing = !prefix_bucket.empty();
+    uint64_t job_id;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        job_id = next_job_id_++;
+        jobs_.emplace(job_id, job);
+        // Forget the oldest jobs; a client polls its job soon after submitting
+        while (jobs_.size() > Constants::WarmupJobsKept) jobs_.erase(jobs_.begin());
+    }
+    LOG(INFO) << "[WARMUP] Job " << job_id << ": " << objects.size() << " objects"
+              << (prefix_bucket.empty() ? "" : " and prefix " + prefix_bucket + "/" + prefix) << "\n";
+
+    for (const auto& [bucket, file] : objects) enqueue(job, bucket, file, 0);
+    if (job->listing) {
+        // Listing a large prefix takes a while; don't hold the request for
+        // it, and start it ahead of the fills so they have work to follow
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            queue_.push_front(Task{job, prefix_bucket, prefix, true});
+        }
+        cond_.notify_one();
+    }
+    return job_id;
+}
+
+std::optional<WarmupProgress> WarmupJobs::progress(uint64_t job_id) {
+    std::shared_ptr<Job> job;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto it = jobs_.find(job_id);
+        if (it == jobs_.end()) return std::nullopt;
+        job = it->second;
+    }
+
+    std::lock_guard<std::mutex> lock(job->mutex);
+    size_t finished = job->objects_done + job->objects_failed + job->objects_skipped;
+    std::string state = job->listing ? "listing" : finished < job->objects_total ? "running" : "done";
+    return WarmupProgress{state, job->objects_total, job->objects_done, job->objects_failed,
+                          job->objects_skipped, job->bytes, job->errors};
+}
+
+void WarmupJobs::enqueue(const std::shared_ptr<Job>& job, const std::string& bucket, const std::string& file,
+                         uint64_t size) {
+    {
+        std::lock_guard<std::mutex> lock(job->mutex);
+        ++job->objects_total;
+        if (job->bytes_planned + size > disk_budget_) {
+            ++job->objects_skipped;
+            return;
+        }
+        job->bytes_planned += size;
+    }
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        queue_.push_back(Task{job, bucket, file});
+    }
+    cond_.notify_one();
+}
+
+void WarmupJobs::list_prefix(const std::shared_ptr<Job>& job, const std::string& bucket, const std::string& prefix) {
+    try {
+        cache_.list_objects(bucket, prefix, [&](const std::string& file, uint64_t size) {
+            {
+                std::lock_guard<std::mutex> lock(mutex_);
+                if (stopping_) return false;
+            }
+            enqueue(job, bucket, file, size);
+            return true;
+        });
+    } catch (const std::exception& e) {
+        LOG(ERROR) << "[WARMUP] Listing " << bucket << "/" << prefix << " failed: " << e.what() << "\n";
+        std::lock_guard<std::mutex> lock(job->mutex);
+        job->errors.push_back("list " + bucket + "/" + prefix + ": " + e.what());
+    }
+    std::lock_guard<std::mutex> lock(job->mutex);
+    job->listing = false;
+}
+
+void WarmupJobs::run_worker() {
+    while (true) {
+        Task task;
+        {
+            std::unique_lock<std::mutex> lock(mutex_);
+            cond_.wait(lock, [&] { return stopping_ || !queue_.empty(); });
+            if (stopping_) return;
+            task = std::move(queue_.front());
+            queue_.pop_front();
+        }
+
+        if (task.list) {
+            list_prefix(task.job, task.bucket, task.file);
+            continue;
+        }
+
+        {
+            // Objects listed without a size count against the budget once filled
+            std::lock_guard<std::mutex> lock(task.job->mutex);
+            if (task.job->bytes >= disk_budget_) {
+                ++task.job->objects_skipped;
+                continue;
+            }
+        }
+
+        try {
+            uint64_t bytes = cache_.warm_object(task.file, task.bucket);
+            std::lock_guard<std::mutex> lock(task.job->mutex);
+            ++task.job->objects_done;
+            task.job->bytes += bytes;
+        } catch (const std::exception& e) {
+            LOG(WARNING) << "[WARMUP] Warming " << task.bucket << "/" << task.file << " failed: " << e.what() << "\n";
+            std::lock_guard<std::mutex> lock(task.job->mutex);
+            ++task.job->objects_failed;
+            if (task.job->errors.size() < Constants::WarmupErrorsKept) {
+                task.job->errors.push_back(task.bucket + "/" + task.file + ": " + e.what());
+            }
+        }
+    }
+}
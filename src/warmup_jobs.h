@@ -0,0 +1,82 @@
+#pragma once
+#include <condition_variable>
+#include <deque>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+class GCSCache;
+
+struct WarmupProgress {
+    std::string state;          // listing, running or done
+    size_t objects_total;
+    size_t objects_done;
+    size_t objects_failed;
+    size_t objects_skipped;     // left out to stay within max_disk
+    uint64_t bytes;
+    std::vector<std::string> errors;
+};
+
+// Warms the cache ahead of a batch job. Each job fills a list of objects,
+// and optionally everything under a bucket prefix, through the cache's
+// normal fill path. A shared pool of workers bounds how many fills all jobs
+// run at once, and also lists the prefixes, so shutdown waits for no more
+// than the page being listed. A job stops adding objects once the bytes it warmed would
+// exceed max_disk, since anything past that would only evict what it
+// warmed earlier.
+class WarmupJobs {
+public:
+    using ObjectList = std::vector<std::pair<std::string, std::string>>;    // bucket, file
+
+    WarmupJobs(GCSCache& cache, size_t concurrency, uint64_t disk_budget);
+    ~WarmupJobs();
+
+    WarmupJobs(const WarmupJobs&) = delete;
+    WarmupJobs& operator=(const WarmupJobs&) = delete;
+
+    // Returns the new job's id. prefix_bucket is empty when there is no
+    // prefix to list.
+    uint64_t submit(ObjectList objects, const std::string& prefix_bucket, const std::string& prefix);
+
+    std::optional<WarmupProgress> progress(uint64_t job_id);
+
+private:
+    struct Job {
+        std::mutex mutex;
+        bool listing = false;
+        size_t objects_total = 0;
+        size_t objects_done = 0;
+        size_t objects_failed = 0;
+        size_t objects_skipped = 0;
+        uint64_t bytes = 0;
+        uint64_t bytes_planned = 0;     // sizes of objects queued, where known
+        std::vector<std::string> errors;
+    };
+
+    struct Task {
+        std::shared_ptr<Job> job;
+        std::string bucket;
+        std::string file;
+        bool list = false;      // file is a prefix to list
+    };
+
+    GCSCache& cache_;
+    const uint64_t disk_budget_;
+
+    std::mutex mutex_;
+    std::condition_variable cond_;
+    std::deque<Task> queue_;
+    std::map<uint64_t, std::shared_ptr<Job>> jobs_;
+    uint64_t next_job_id_ = 1;
+    bool stopping_ = false;
+    std::vector<std::thread> workers_;
+
+    void enqueue(const std::shared_ptr<Job>& job, const std::string& bucket, const std::string& file, uint64_t size);
+    void list_prefix(const std::shared_ptr<Job>& job, const std::string& bucket, const std::string& prefix);
+    void run_worker();
+};
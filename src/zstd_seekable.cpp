@@ -0,0 +1,182 @@
+#include "zstd_seekable.h"
+#include <algorithm>
+#include <cerrno>
+#include <stdexcept>
+#include <fcntl.h>
+#include <unistd.h>
+#include "constants.h"
+#ifdef HAVE_ZSTD
+#include <zstd.h>
+#endif
+
+namespace {
+
+constexpr uint32_t SkippableMagic = 0x184D2A5E;
+constexpr uint32_t SeekTableMagic = 0x8F92EAB1;
+constexpr size_t SkippableHeaderSize = 8;   // magic, frame size
+constexpr size_t EntrySize = 8;             // compressed size, decompressed size
+constexpr size_t FooterSize = 9;            // frame count, descriptor, magic
+
+uint32_t get_u32(const unsigned char* in) {
+    return in[0] | in[1] << 8 | in[2] << 16 | static_cast<uint32_t>(in[3]) << 24;
+}
+
+bool pread_all(int fd, void* buffer, size_t len, size_t offset) {
+    auto* out = static_cast<char*>(buffer);
+    while (len > 0) {
+        ssize_t bytes_read = ::pread(fd, out, len, offset);
+        if (bytes_read < 0 && errno == EINTR) continue;
+        if (bytes_read <= 0) return false;
+        out += bytes_read;
+        len -= bytes_read;
+        offset += bytes_read;
+    }
+    return true;
+}
+
+#ifdef HAVE_ZSTD
+void put_u32(std::string& out, uint32_t value) {
+    for (int i = 0; i < 4; ++i) out.push_back(static_cast<char>(value >> (8 * i)));
+}
+
+bool write_all(int fd, const char* data, size_t len) {
+    while (len > 0) {
+        ssize_t written = ::write(fd, data, len);
+        if (written < 0) {
+            if (errno == EINTR) continue;
+            return false;
+        }
+        data += written;
+        len -= written;
+    }
+    return true;
+}
+
+struct FreeCCtx {
+    void operator()(ZSTD_CCtx* ctx) const { ZSTD_freeCCtx(ctx); }
+};
+
+struct FreeDCtx {
+    void operator()(ZSTD_DCtx* ctx) const { ZSTD_freeDCtx(ctx); }
+};
+#endif
+
+}  // namespace
+
+bool SeekableZstd::available() {
+#ifdef HAVE_ZSTD
+    return true;
+#else
+    return false;
+#endif
+}
+
+#ifdef HAVE_ZSTD
+
+bool SeekableZstd::compress(const char* data, size_t size, int level, const std::string& path) {
+    if (size == 0) return false;
+    std::unique_ptr<ZSTD_CCtx, FreeCCtx> ctx(ZSTD_createCCtx());
+    if (!ctx) throw std::runtime_error("Failed to create a zstd context");
+
+    int fd = -1;
+    std::string frame(ZSTD_compressBound(Constants::CompressFrameSize), '\0');
+    std::string table;
+    put_u32(table, SkippableMagic);
+    put_u32(table, 0);  // frame size, once the count is known
+    size_t compressed_total = 0;
+    uint32_t count = 0;
+    try {
+        for (size_t offset = 0; offset < size; offset += Constants::CompressFrameSize) {
+            size_t len = std::min(Constants::CompressFrameSize, size - offset);
+            size_t compressed = ZSTD_compressCCtx(ctx.get(), frame.data(), frame.size(), data + offset, len, level);
+            if (ZSTD_isError(compressed)) {
+                throw std::runtime_error(std::string("zstd: ") + ZSTD_getErrorName(compressed));
+            }
+            if (offset == 0 && compressed * 100 > len * Constants::CompressMaxRatioPct) return false;
+            compressed_total += compressed;
+            if (fd < 0) {
+                fd = ::open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+                if (fd < 0) throw std::runtime_error("Failed to create " + path);
+            }
+            if (!write_all(fd, frame.data(), compressed)) throw std::runtime_error("Failed to write " + path);
+            put_u32(table, compressed);
+            put_u32(table, len);
+            ++count;
+        }
+
+        put_u32(table, count);
+        table.push_back(0);     // descriptor: no checksums
+        put_u32(table, SeekTableMagic);
+        uint32_t table_frame_size = table.size() - SkippableHeaderSize;
+        for (int i = 0; i < 4; ++i) table[4 + i] = static_cast<char>(table_frame_size >> (8 * i));
+
+        if ((compressed_total + table.size()) * 100 > size * Constants::CompressMaxRatioPct) {
+            // The start compressed, the object as a whole did not
+            ::close(fd);
+            ::unlink(path.c_str());
+            return false;
+        }
+        if (!write_all(fd, table.data(), table.size())) throw std::runtime_error("Failed to write " + path);
+    } catch (const std::exception&) {
+        if (fd >= 0) {
+            ::close(fd);
+            ::unlink(path.c_str());
+        }
+        throw;
+    }
+    ::close(fd);
+    return true;
+}
+
+std::shared_ptr<const std::string> SeekableZstd::read_frame(int fd, const Frame& frame) {
+    thread_local std::unique_ptr<ZSTD_DCtx, FreeDCtx> ctx(ZSTD_createDCtx());
+    std::string compressed(frame.compressed_size, '\0');
+    if (!pread_all(fd, compressed.data(), compressed.size(), frame.offset)) {
+        throw std::runtime_error("Failed to read compressed frame");
+    }
+    auto data = std::make_shared<std::string>(frame.size, '\0');
+    size_t size = ZSTD_decompressDCtx(ctx.get(), data->data(), data->size(), compressed.data(), compressed.size());
+    if (ZSTD_isError(size) || size != frame.size) {
+        throw std::runtime_error("Corrupt zstd frame at offset " + std::to_string(frame.offset));
+    }
+    return data;
+}
+
+#else
+
+bool SeekableZstd::compress(const char*, size_t, int, const std::string&) {
+    return false;
+}
+
+std::shared_ptr<const std::string> SeekableZstd::read_frame(int, const Frame&) {
+    throw std::runtime_error("Compressed cache file, but built without zstd");
+}
+
+#endif
+
+bool SeekableZstd::read_frames(int fd, size_t file_size, std::vector<Frame>& frames) {
+    unsigned char footer[FooterSize];
+    if (file_size < SkippableHeaderSize + FooterSize) return false;
+    if (!pread_all(fd, footer, FooterSize, file_size - FooterSize)) return false;
+    if (get_u32(footer + 5) != SeekTableMagic || footer[4] != 0) return false;
+
+    uint64_t count = get_u32(footer);
+    uint64_t table_size = SkippableHeaderSize + count * EntrySize + FooterSize;
+    if (table_size > file_size) return false;
+    std::vector<unsigned char> table(table_size - FooterSize);
+    if (!pread_all(fd, table.data(), table.size(), file_size - table_size)) return false;
+    if (get_u32(table.data()) != SkippableMagic ||
+        get_u32(table.data() + 4) != table_size - SkippableHeaderSize) {
+        return false;
+    }
+
+    frames.clear();
+    uint64_t offset = 0;
+    for (uint64_t i = 0; i < count; ++i) {
+        const unsigned char* entry = table.data() + SkippableHeaderSize + i * EntrySize;
+        Frame frame{offset, get_u32(entry), get_u32(entry + 4)};
+        offset += frame.compressed_size;
+        frames.push_back(frame);
+    }
+    return offset == file_size - table_size;
+}
@@ -0,0 +1,38 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+// Objects kept compressed on disk, in zstd's seekable format: the object
+// cut into frames of CompressFrameSize bytes, each compressed on its own,
+// followed by a skippable frame holding every frame's compressed and
+// decompressed size. Any zstd decoder reads such a file as the whole
+// object; the seek table lets the cache decompress only the frames a range
+// touches.
+class SeekableZstd {
+public:
+    struct Frame {
+        uint64_t offset;            // in the compressed file
+        uint32_t compressed_size;
+        uint32_t size;
+    };
+
+    // Whether this build has zstd
+    static bool available();
+
+    // Writes the size bytes at data to path, compressed at level. Returns
+    // false, leaving nothing at path, if they do not shrink below
+    // CompressMaxRatioPct of their size; the first frame is tried before the
+    // rest, so incompressible data costs one frame's work. Throws on write
+    // errors.
+    static bool compress(const char* data, size_t size, int level, const std::string& path);
+
+    // Reads the seek table of the file open at fd. Returns false if it is not
+    // a seekable zstd file.
+    static bool read_frames(int fd, size_t file_size, std::vector<Frame>& frames);
+
+    // Reads one frame from fd and decompresses it. Throws if it is corrupt.
+    static std::shared_ptr<const std::string> read_frame(int fd, const Frame& frame);
+};
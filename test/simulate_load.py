@@ -7,6 +7,7 @@ from concurrent.futures import ThreadPoolExecutor
 
 # === Config ===
 SERVER_URL = "http://localhost:8080/object"
+STATS_URL = "http://localhost:8080/stats"
 BUCKET_NAME = "my_bucket"
 REQUESTS_PER_CLIENT = 50
 CLIENT_COUNT = 10
@@ -61,15 +62,46 @@ def run_polite_clients():
         for future in futures:
             future.result()
 
+def run_trace(trace_file):
+    """Replays a recorded trace, one '<file>' or '<bucket> <file>' per line, in order."""
+    print(f"Replaying trace {trace_file}...")
+    with open(trace_file) as f:
+        entries = [line.split() for line in f if line.strip()]
+    for entry in entries:
+        bucket, file_name = (BUCKET_NAME, entry[0]) if len(entry) == 1 else entry[:2]
+        params = {"bucket": bucket, "file": file_name, "client_id": "trace"}
+        r = requests.get(SERVER_URL, params=params)
+        if r.status_code != 200:
+            print(f"[ERROR] got {r.status_code} for {bucket}/{file_name}")
+    stats = requests.get(STATS_URL).json()
+    print(f"Replayed {len(entries)} requests: hit_ratio={stats['hit_ratio']:.3f} "
+          f"(hits={stats['hits']}, ram_hits={stats['ram_hits']}, misses={stats['misses']}, bypassed={stats['bypassed']})")
+
+def run_fill():
+    """Fetches every file once, one at a time, and prints the fill throughput. Run against a fresh cache."""
+    print("Running cold fill test...")
+    total_bytes = 0
+    start = time.time()
+    for i in range(1, 11):
+        params = {"bucket": BUCKET_NAME, "file": f"random_file_{i}.bin", "client_id": "fill"}
+        r = requests.get(SERVER_URL, params=params)
+        if r.status_code != 200:
+            print(f"[ERROR] got {r.status_code} for random_file_{i}.bin")
+        total_bytes += len(r.content)
+    duration = time.time() - start
+    mb = total_bytes / (1024 * 1024)
+    print(f"Filled {mb:.1f} MB in {duration:.2f}s: {mb / duration:.1f} MB/s")
+
 # === Main CLI Control ===
 def main():
     parser = argparse.ArgumentParser(description="Simulate GCS cache load")
     parser.add_argument(
         "-s", "--scenario",
-        choices=["noisy", "polite", "both"],
+        choices=["noisy", "polite", "both", "trace", "fill"],
         required=True,
-        help="Test scenario to run: 'noisy', 'polite', or 'both'"
+        help="Test scenario to run: 'noisy', 'polite', 'both', 'trace' or 'fill'"
     )
+    parser.add_argument("-t", "--trace", help="Trace file for the 'trace' scenario")
     args = parser.parse_args()
 
     if args.scenario == "noisy":
@@ -81,6 +113,12 @@ def main():
         noisy_thread.start()
         run_polite_clients()
         noisy_thread.join()
+    elif args.scenario == "fill":
+        run_fill()
+    elif args.scenario == "trace":
+        if not args.trace:
+            parser.error("--trace is required for the 'trace' scenario")
+        run_trace(args.trace)
 
 if __name__ == "__main__":
     main()